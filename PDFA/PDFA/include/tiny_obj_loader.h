@@ -5,6 +5,8 @@
 //
 
 //
+// local change  : Open addressing vertex cache passed by reference, with a
+//                 direct lookup path for faces using matching v/vt/vn indices.
 // version 0.9.20: Fixes creating per-face material using `usemtl`(#68)
 // version 0.9.17: Support n-polygon and crease tag(OpenSubdiv extension)
 // version 0.9.16: Make tinyobjloader header-only
@@ -149,6 +151,109 @@ bool LoadObj(std::vector<shape_t> &shapes,       // [output]
 void LoadMtl(std::map<std::string, int> &material_map, // [output]
              std::vector<material_t> &materials,       // [output]
              std::istream &inStream);
+
+// A face corner: the zero-based indices of its position, texcoord and normal,
+// -1 when absent.
+struct vertex_index {
+  int v_idx, vt_idx, vn_idx;
+  vertex_index() : v_idx(-1), vt_idx(-1), vn_idx(-1) {}
+  explicit vertex_index(int idx) : v_idx(idx), vt_idx(idx), vn_idx(idx) {}
+  vertex_index(int vidx, int vtidx, int vnidx)
+      : v_idx(vidx), vt_idx(vtidx), vn_idx(vnidx) {}
+};
+
+// Maps a (v, vt, vn) triple to the index of the vertex emitted for it.
+// Open addressing with linear probing; the slot storage is kept between face
+// groups so clearing does not free memory. Shared with the ObjParser of the
+// application.
+class vertex_cache {
+public:
+  static const unsigned int EMPTY = 0xffffffffu;
+
+  vertex_cache() : count_(0) {}
+
+  void clear() {
+    if (count_ == 0)
+      return;
+    for (size_t i = 0; i < slots_.size(); i++)
+      slots_[i].value = EMPTY;
+    count_ = 0;
+  }
+
+  // Returns the value slot for `key`, EMPTY if the key was not present. A
+  // caller that fills an EMPTY slot must call inserted() afterwards.
+  unsigned int &lookup(const vertex_index &key) {
+    if ((count_ + 1) * 2 > slots_.size())
+      grow();
+    size_t mask = slots_.size() - 1;
+    size_t i = hash(key) & mask;
+    for (;;) {
+      slot &s = slots_[i];
+      if (s.value == EMPTY) {
+        s.key = key;
+        return s.value;
+      }
+      if (s.key.v_idx == key.v_idx && s.key.vt_idx == key.vt_idx &&
+          s.key.vn_idx == key.vn_idx)
+        return s.value;
+      i = (i + 1) & mask;
+    }
+  }
+
+  void inserted() { count_++; }
+
+private:
+  struct slot {
+    vertex_index key;
+    unsigned int value;
+  };
+  std::vector<slot> slots_;
+  size_t count_;
+
+  static size_t hash(const vertex_index &key) {
+    unsigned int h = static_cast<unsigned int>(key.v_idx) * 0x9E3779B1u;
+    h ^= static_cast<unsigned int>(key.vt_idx) * 0x85EBCA77u;
+    h ^= static_cast<unsigned int>(key.vn_idx) * 0xC2B2AE3Du;
+    return static_cast<size_t>(h ^ (h >> 15));
+  }
+
+  void grow() {
+    std::vector<slot> old;
+    old.swap(slots_);
+    slot empty;
+    empty.value = EMPTY;
+    slots_.assign(old.empty() ? 1024 : old.size() * 2, empty);
+    size_t mask = slots_.size() - 1;
+    for (size_t j = 0; j < old.size(); j++) {
+      if (old[j].value == EMPTY)
+        continue;
+      size_t i = hash(old[j].key) & mask;
+      while (slots_[i].value != EMPTY)
+        i = (i + 1) & mask;
+      slots_[i] = old[j];
+    }
+  }
+};
+
+// When every corner of a face group refers to its position, texcoord and
+// normal through the same index (`f 1//1 2//2 3//3`), the triple is fully
+// determined by v_idx and the cache becomes a plain array indexed by it.
+// Checks `count` corners against the attributes present in `first`, the
+// first corner of the group. Shared with the ObjParser of the application.
+inline bool usesMatchingIndices(const vertex_index &first,
+                                const vertex_index *corners, size_t count,
+                                int vsize) {
+  bool has_vt = first.vt_idx >= 0;
+  bool has_vn = first.vn_idx >= 0;
+  for (size_t k = 0; k < count; k++) {
+    const vertex_index &vi = corners[k];
+    if (vi.v_idx < 0 || vi.v_idx >= vsize ||
+        vi.vt_idx != (has_vt ? vi.v_idx : -1) ||
+        vi.vn_idx != (has_vn ? vi.v_idx : -1))
+      return false;
+  }
+  return true;
+}
 }
 
 #ifdef TINYOBJLOADER_IMPLEMENTATION
@@ -173,14 +278,6 @@ MaterialReader::~MaterialReader() {}
 
 #define TINYOBJ_SSCANF_BUFFER_SIZE (4096)
 
-struct vertex_index {
-  int v_idx, vt_idx, vn_idx;
-  vertex_index() : v_idx(-1), vt_idx(-1), vn_idx(-1) {}
-  explicit vertex_index(int idx) : v_idx(idx), vt_idx(idx), vn_idx(idx) {}
-  vertex_index(int vidx, int vtidx, int vnidx)
-      : v_idx(vidx), vt_idx(vtidx), vn_idx(vnidx) {}
-};
-
 struct tag_sizes {
   tag_sizes() : num_ints(0), num_floats(0), num_strings(0) {}
   int num_ints;
@@ -188,16 +285,24 @@ struct tag_sizes {
   int num_strings;
 };
 
-// for std::map
-static inline bool operator<(const vertex_index &a, const vertex_index &b) {
-  if (a.v_idx != b.v_idx)
-    return (a.v_idx < b.v_idx);
-  if (a.vn_idx != b.vn_idx)
-    return (a.vn_idx < b.vn_idx);
-  if (a.vt_idx != b.vt_idx)
-    return (a.vt_idx < b.vt_idx);
+// Vertex de-duplication state shared by all the face groups of a file.
+struct vertex_dedup {
+  vertex_cache cache;
+  std::vector<unsigned int> direct; // indexed by v_idx, see usesMatchingIndices
+};
 
-  return false;
+// The matching-index test of every face of a group, against the first corner.
+static bool usesMatchingIndices(
+    const std::vector<std::vector<vertex_index> > &faceGroup, int vsize) {
+  if (faceGroup[0].empty())
+    return false;
+  for (size_t i = 0; i < faceGroup.size(); i++) {
+    const std::vector<vertex_index> &face = faceGroup[i];
+    if (!face.empty() && !usesMatchingIndices(faceGroup[0][0], &face[0],
+                                              face.size(), vsize))
+      return false;
+  }
+  return true;
 }
 
 struct obj_shape {
@@ -451,17 +556,19 @@ static vertex_index parseTriple(const char *&token, int vsize, int vnsize,
 }
 
 static unsigned int
-updateVertex(std::map<vertex_index, unsigned int> &vertexCache,
+updateVertex(vertex_dedup &vertexCache, bool direct,
              std::vector<float> &positions, std::vector<float> &normals,
              std::vector<float> &texcoords,
              const std::vector<float> &in_positions,
              const std::vector<float> &in_normals,
              const std::vector<float> &in_texcoords, const vertex_index &i) {
-  const std::map<vertex_index, unsigned int>::iterator it = vertexCache.find(i);
+  unsigned int &cached =
+      direct ? vertexCache.direct[static_cast<size_t>(i.v_idx)]
+             : vertexCache.cache.lookup(i);
 
-  if (it != vertexCache.end()) {
+  if (cached != vertex_cache::EMPTY) {
     // found cache
-    return it->second;
+    return cached;
   }
 
   assert(in_positions.size() > static_cast<unsigned int>(3 * i.v_idx + 2));
@@ -484,7 +591,9 @@ updateVertex(std::map<vertex_index, unsigned int> &vertexCache,
   }
 
   unsigned int idx = static_cast<unsigned int>(positions.size() / 3 - 1);
-  vertexCache[i] = idx;
+  cached = idx;
+  if (!direct)
+    vertexCache.cache.inserted();
 
   return idx;
 }
@@ -513,7 +622,7 @@ static void InitMaterial(material_t &material) {
 }
 
 static bool exportFaceGroupToShape(
-    shape_t &shape, std::map<vertex_index, unsigned int> vertexCache,
+    shape_t &shape, vertex_dedup &vertexCache,
     const std::vector<float> &in_positions,
     const std::vector<float> &in_normals,
     const std::vector<float> &in_texcoords,
@@ -524,6 +633,12 @@ static bool exportFaceGroupToShape(
     return false;
   }
 
+  size_t vsize = in_positions.size() / 3;
+  bool direct = usesMatchingIndices(faceGroup, static_cast<int>(vsize));
+  if (direct && vertexCache.direct.size() < vsize)
+    vertexCache.direct.resize(vsize,
+                              static_cast<unsigned int>(vertex_cache::EMPTY));
+
   // Flatten vertices and indices
   for (size_t i = 0; i < faceGroup.size(); i++) {
     const std::vector<vertex_index> &face = faceGroup[i];
@@ -542,13 +657,13 @@ static bool exportFaceGroupToShape(
         i2 = face[k];
 
         unsigned int v0 = updateVertex(
-            vertexCache, shape.mesh.positions, shape.mesh.normals,
+            vertexCache, direct, shape.mesh.positions, shape.mesh.normals,
             shape.mesh.texcoords, in_positions, in_normals, in_texcoords, i0);
         unsigned int v1 = updateVertex(
-            vertexCache, shape.mesh.positions, shape.mesh.normals,
+            vertexCache, direct, shape.mesh.positions, shape.mesh.normals,
             shape.mesh.texcoords, in_positions, in_normals, in_texcoords, i1);
         unsigned int v2 = updateVertex(
-            vertexCache, shape.mesh.positions, shape.mesh.normals,
+            vertexCache, direct, shape.mesh.positions, shape.mesh.normals,
             shape.mesh.texcoords, in_positions, in_normals, in_texcoords, i2);
 
         shape.mesh.indices.push_back(v0);
@@ -562,9 +677,9 @@ static bool exportFaceGroupToShape(
 
       for (size_t k = 0; k < npolys; k++) {
         unsigned int v =
-            updateVertex(vertexCache, shape.mesh.positions, shape.mesh.normals,
-                         shape.mesh.texcoords, in_positions, in_normals,
-                         in_texcoords, face[k]);
+            updateVertex(vertexCache, direct, shape.mesh.positions,
+                         shape.mesh.normals, shape.mesh.texcoords, in_positions,
+                         in_normals, in_texcoords, face[k]);
 
         shape.mesh.indices.push_back(v);
       }
@@ -577,8 +692,15 @@ static bool exportFaceGroupToShape(
   shape.name = name;
   shape.mesh.tags.swap(tags);
 
-  if (clearCache)
-    vertexCache.clear();
+  if (clearCache) {
+    vertexCache.cache.clear();
+    if (direct) {
+      for (size_t i = 0; i < faceGroup.size(); i++)
+        for (size_t k = 0; k < faceGroup[i].size(); k++)
+          vertexCache.direct[static_cast<size_t>(faceGroup[i][k].v_idx)] =
+              vertex_cache::EMPTY;
+    }
+  }
 
   return true;
 }
@@ -874,7 +996,7 @@ bool LoadObj(std::vector<shape_t> &shapes,       // [output]
 
   // material
   std::map<std::string, int> material_map;
-  std::map<vertex_index, unsigned int> vertexCache;
+  vertex_dedup vertexCache;
   int material = -1;
 
   shape_t shape;
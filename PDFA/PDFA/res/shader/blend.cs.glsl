@@ -0,0 +1,27 @@
+//compiled after deltasBuffer.glsl, which has the #version line, and blendShapes.glsl
+
+//blend every vertex once into the vertex buffers that all the passes draw
+layout(local_size_x = 64) in;
+
+//the bindings of the blended mesh are those read and written by the normal passes
+layout(std430, binding = 0) writeonly buffer Positions { float positions[]; };
+layout(std430, binding = 1) readonly buffer NeutralPositions { float neutralPositions[]; };
+layout(std430, binding = 2) readonly buffer NeutralNormals { float neutralNormals[]; };
+layout(std430, binding = 6) writeonly buffer Normals { float normals[]; };
+
+void main()
+{
+	uint v = gl_GlobalInvocationID.x;
+	if (v >= uint(numVertices)) return;
+
+	vec3 pos = vec3(neutralPositions[3 * v], neutralPositions[3 * v + 1], neutralPositions[3 * v + 2]);
+	vec3 norm = vec3(neutralNormals[3 * v], neutralNormals[3 * v + 1], neutralNormals[3 * v + 2]);
+	blendVertex(v, pos, norm);
+
+	positions[3 * v] = pos.x;
+	positions[3 * v + 1] = pos.y;
+	positions[3 * v + 2] = pos.z;
+	normals[3 * v] = norm.x;
+	normals[3 * v + 1] = norm.y;
+	normals[3 * v + 2] = norm.z;
+}
@@ -0,0 +1,115 @@
+//the blending of the morphing targets, shared by the vertex shader and the
+//blend compute shader; it is compiled after deltasBuffer.glsl or
+//deltasTexture.glsl, which carry the #version line and deltaWord
+
+//the deltas of all the targets are in one buffer, target after target,
+//the position then the normal delta of a vertex side by side, so the
+//number of targets is not bound by the vertex attributes. A target is
+//stored densely, every vertex in order, or sparsely when that is smaller:
+//the sorted indices of the vertices it moves, their deltas, then the
+//deltas of the vertices left out (zero, encoded)
+#define MAX_ACTIVE_TARGETS 511
+#define DELTAS_FLOAT 1
+#define DELTAS_HALF  2
+#define DELTAS_SHORT 3
+#define DELTAS_BYTE  4
+
+//a target with a weight that is not zero, the weight times the decoding
+//scale of its deltas, and where they are stored: the first word of the
+//target and the number of vertices listed, numVertices when it is dense
+struct ActiveTarget
+{
+	vec3 posWeight;
+	uint offset;
+	vec3 normWeight;
+	uint count;
+};
+
+//the weighted sum of the decoding offsets of quantized deltas, then the
+//active targets; only the first numActive are written every frame, 16 KB
+//at most, the smallest uniform block size allowed; bound by the application
+layout(std140) uniform Weights
+{
+	vec4 posBias;
+	vec4 normBias;
+	ActiveTarget activeTargets[MAX_ACTIVE_TARGETS];
+};
+
+uniform int numActive;
+uniform int numVertices;
+uniform int deltaFormat;
+uniform int deltaNormals;   //0 when only the position deltas are stored, the normals being recomputed
+
+//words of the deltas of a vertex
+uint vertexWords()
+{
+	uint bytes = deltaFormat == DELTAS_FLOAT ? 4u : deltaFormat == DELTAS_BYTE ? 1u : 2u;
+	return ((deltaNormals != 0 ? 6u : 3u) * bytes + 3u) / 4u;
+}
+
+//the first word of the deltas of vertex in a target, by a binary search of
+//the vertices listed when it is sparse
+uint findDeltas(uint offset, uint count, uint vertex)
+{
+	if (count == uint(numVertices)) return offset + vertex * vertexWords();
+	uint lo = 0u, hi = count;
+	while (lo < hi)
+	{
+		uint mid = (lo + hi) / 2u;
+		if (deltaWord(offset + mid) < vertex) lo = mid + 1u;
+		else hi = mid;
+	}
+	if (lo < count && deltaWord(offset + lo) != vertex) lo = count;
+	return offset + count + lo * vertexWords();
+}
+
+//decode the deltas of a vertex starting at word i, the normal delta is zero when not stored
+void fetchDeltas(uint i, out vec3 pos, out vec3 norm)
+{
+	norm = vec3(0.0);
+	if (deltaFormat == DELTAS_FLOAT)
+	{
+		pos = uintBitsToFloat(uvec3(deltaWord(i), deltaWord(i + 1u), deltaWord(i + 2u)));
+		if (deltaNormals != 0) norm = uintBitsToFloat(uvec3(deltaWord(i + 3u), deltaWord(i + 4u), deltaWord(i + 5u)));
+	}
+	else if (deltaFormat == DELTAS_BYTE)
+	{
+		vec4 a = decodeSnorm4x8(deltaWord(i));
+		pos = a.xyz;
+		if (deltaNormals != 0) norm = vec3(a.w, decodeSnorm4x8(deltaWord(i + 1u)).xy);
+	}
+	else
+	{
+		vec2 a, b, c = vec2(0.0);
+		if (deltaFormat == DELTAS_HALF)
+		{
+			a = decodeHalf2x16(deltaWord(i));
+			b = decodeHalf2x16(deltaWord(i + 1u));
+			if (deltaNormals != 0) c = decodeHalf2x16(deltaWord(i + 2u));
+		}
+		else
+		{
+			a = decodeSnorm2x16(deltaWord(i));
+			b = decodeSnorm2x16(deltaWord(i + 1u));
+			if (deltaNormals != 0) c = decodeSnorm2x16(deltaWord(i + 2u));
+		}
+		pos = vec3(a, b.x);
+		if (deltaNormals != 0) norm = vec3(b.y, c);
+	}
+}
+
+//add the weighted deltas of the active targets to the neutral position and normal of a vertex
+void blendVertex(uint vertex, inout vec3 pos, inout vec3 norm)
+{
+	//an already blended mesh is drawn with no targets, and no offsets either
+	if (numActive == 0) return;
+	pos  += posBias.xyz;
+	norm += normBias.xyz;
+	for (int a = 0; a < numActive; a++)
+	{
+		vec3 p, n;
+		fetchDeltas(findDeltas(activeTargets[a].offset, activeTargets[a].count, vertex), p, n);
+		pos  += p * activeTargets[a].posWeight;
+		norm += n * activeTargets[a].normWeight;
+	}
+}
@@ -1,4 +1,4 @@
-#version 430 core
+#version 330 core
 
 in vec2 txcoord;
 in vec3 w_position;
@@ -6,15 +6,27 @@ in vec3 w_normal;
 
 //texture mapping
 uniform sampler2D sampler;
-uniform bool hasTexture = false;
 
-//simple lighting
-uniform vec3 eyepos;
-uniform vec3 light;
-uniform vec3 ambient;
-uniform vec3 diffuse;
-uniform vec3 specular;
-uniform float delta;
+//per frame constants, the same block in the vertex and the fragment shader,
+//bound by the application
+layout(std140) uniform Frame
+{
+	mat4 m2w;
+	mat4 w2v;
+	mat4 persp;
+	vec3 eyepos;
+	vec3 light;
+};
+
+//simple lighting, and whether the texture replaces it
+layout(std140) uniform Material
+{
+	vec3 ambient;
+	vec3 diffuse;
+	vec3 specular;
+	float delta;
+	bool hasTexture;
+};
 
 //output color
 out vec4 color;
@@ -23,7 +35,7 @@ void main(void)
 {
 	if(hasTexture)
 	{
-		color =  texture2D(sampler,txcoord);
+		color =  texture(sampler,txcoord);
 	}
 	else
 	{
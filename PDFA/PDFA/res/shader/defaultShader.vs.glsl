@@ -1,57 +1,41 @@
-#version 430 core
+//compiled after deltasBuffer.glsl or deltasTexture.glsl, which have the
+//#version line, and blendShapes.glsl
 
-uniform mat4 m2w;
-uniform mat4 w2v;
-uniform mat4 persp;
-
-//neutral attributes
-in vec3 vs_position;
-in vec2 vs_texcoord;
-in vec3 vs_norm;
-
-
-#define NUM_BLENDINGSHAPE 6
-//morphing targets 
-//we cannot use more than 6 morph 
-//targets because of the limit of 
-//max vertex attributes number, 
-//which is 16
-in vec3 pos0;
-in vec3 norm0;
-in vec3 pos1;
-in vec3 norm1;
-in vec3 pos2;
-in vec3 norm2;
-in vec3 pos3;
-in vec3 norm3;
-in vec3 pos4;
-in vec3 norm4;
-in vec3 pos5;
-in vec3 norm5;
+//per frame constants, the same block in the vertex and the fragment shader,
+//bound by the application
+layout(std140) uniform Frame
+{
+	mat4 m2w;
+	mat4 w2v;
+	mat4 persp;
+	vec3 eyepos;
+	vec3 light;
+};
+
+//neutral attributes, or an already blended mesh with numActive 0;
+//fixed locations, so the feedback program reads the same vertex arrays
+layout(location = 0) in vec3 vs_position;
+layout(location = 1) in vec2 vs_texcoord;
+layout(location = 2) in vec3 vs_norm;
 
 out vec2 txcoord;
 out vec3 w_position;
 out vec3 w_normal;
 
-
-
-uniform float weights[NUM_BLENDINGSHAPE];
-uniform samplerBuffer bs_sampler;
+//the blended mesh in model space, captured with transform feedback
+out vec3 m_position;
+out vec3 m_normal;
 
 void main(void)
 {
     txcoord = vs_texcoord;
-    
+
     vec3 blended_pos = vs_position;
 	vec3 blended_norm = vs_norm;
 
-	//blending position...
-	blended_pos += pos0  * weights[0];
-	blended_pos += pos1  * weights[1];
-	blended_pos += pos2  * weights[2];
-	blended_pos += pos3  * weights[3];
-	blended_pos += pos4  * weights[4];
-	blended_pos += pos5  * weights[5];
+	//blending position and normal...
+	blendVertex(uint(gl_VertexID), blended_pos, blended_norm);
+
     vec4 position = m2w * vec4(blended_pos,1);
 	position.x /= position.w;
 	position.y /= position.w;
@@ -59,17 +43,12 @@ void main(void)
 	position.w = 1;
 	gl_Position = persp * w2v * position;
 
-	//blending normal...
-	blended_norm += norm0 * weights[0];
-	blended_norm += norm1 * weights[1];
-	blended_norm += norm2 * weights[2];
-	blended_norm += norm3 * weights[3];
-	blended_norm += norm4 * weights[4];
-	blended_norm += norm5 * weights[5];
 	blended_norm = normalize(blended_norm);
+	m_position = blended_pos;
+	m_normal = blended_norm;
 
 	//pass data to fragment shader for shading
 	w_position = position.xyz;
 	w_normal = normalize((m2w*vec4(blended_norm,0)).xyz);
 
-}
\ No newline at end of file
+}
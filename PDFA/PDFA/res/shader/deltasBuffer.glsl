@@ -0,0 +1,33 @@
+#version 430 core
+
+//the words of the deltas read by blendShapes.glsl, from a storage buffer;
+//it is compiled as the first source of the vertex shader and of the blend
+//compute shader on a 4.3 context, deltasTexture.glsl reads the same words
+//on a 3.3 one
+
+layout(std430, binding = 7) readonly buffer Deltas
+{
+	//6 floats, 6 halves or 6 shorts in 3 words, or 6 bytes padded to 2 words per vertex,
+	//half as many without the normal deltas, and the vertex indices of the sparse targets
+	uint deltas[];
+};
+
+uint deltaWord(uint i)
+{
+	return deltas[i];
+}
+
+vec2 decodeHalf2x16(uint word)
+{
+	return unpackHalf2x16(word);
+}
+
+vec2 decodeSnorm2x16(uint word)
+{
+	return unpackSnorm2x16(word);
+}
+
+vec4 decodeSnorm4x8(uint word)
+{
+	return unpackSnorm4x8(word);
+}
@@ -0,0 +1,43 @@
+#version 330 core
+
+//the words of the deltas read by blendShapes.glsl, from a buffer texture
+//over the same buffer as deltasBuffer.glsl, for a 3.3 context: it is
+//compiled as the first source of the vertex shader, which then blends in
+//the draw or with transform feedback
+
+uniform usamplerBuffer deltaTexture;
+
+uint deltaWord(uint i)
+{
+	return texelFetch(deltaTexture, int(i)).r;
+}
+
+//unpackHalf2x16, unpackSnorm2x16 and unpackSnorm4x8 come with GLSL 4.00 and 4.20
+
+float decodeHalf(uint h)
+{
+	uint s = (h & 0x8000u) << 16;
+	uint exponent = (h >> 10) & 0x1fu;
+	uint mantissa = h & 0x3ffu;
+	if (exponent == 0u) return (s != 0u ? -1.0 : 1.0) * float(mantissa) * exp2(-24.0);
+	if (exponent == 31u) return uintBitsToFloat(s | 0x7f800000u | (mantissa << 13));
+	return uintBitsToFloat(s | ((exponent + 112u) << 23) | (mantissa << 13));
+}
+
+vec2 decodeHalf2x16(uint word)
+{
+	return vec2(decodeHalf(word & 0xffffu), decodeHalf(word >> 16));
+}
+
+//the signed fields are sign extended by shifting them to the top and back
+vec2 decodeSnorm2x16(uint word)
+{
+	ivec2 v = ivec2(int(word << 16), int(word)) >> 16;
+	return clamp(vec2(v) / 32767.0, -1.0, 1.0);
+}
+
+vec4 decodeSnorm4x8(uint word)
+{
+	ivec4 v = ivec4(int(word << 24), int(word << 16), int(word << 8), int(word)) >> 24;
+	return clamp(vec4(v) / 127.0, -1.0, 1.0);
+}
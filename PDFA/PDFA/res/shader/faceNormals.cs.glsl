@@ -0,0 +1,29 @@
+#version 430 core
+
+//area weighted normal of every triangle of the blended mesh
+layout(local_size_x = 64) in;
+
+layout(std430, binding = 0) readonly buffer Positions { float positions[]; };
+layout(std430, binding = 1) readonly buffer Indices { uint indices[]; };
+layout(std430, binding = 2) writeonly buffer FaceNormals { float faceNormals[]; };
+
+uniform uint numTriangles;
+
+vec3 position(uint v)
+{
+	return vec3(positions[3 * v], positions[3 * v + 1], positions[3 * v + 2]);
+}
+
+void main()
+{
+	uint t = gl_GlobalInvocationID.x;
+	if (t >= numTriangles) return;
+
+	vec3 a = position(indices[3 * t]);
+	vec3 b = position(indices[3 * t + 1]);
+	vec3 c = position(indices[3 * t + 2]);
+	vec3 n = cross(b - a, c - a);
+	faceNormals[3 * t] = n.x;
+	faceNormals[3 * t + 1] = n.y;
+	faceNormals[3 * t + 2] = n.z;
+}
@@ -0,0 +1,30 @@
+#version 430 core
+
+//sum the normals of the triangles around every vertex, see MeshNormals::Adjacency
+layout(local_size_x = 64) in;
+
+layout(std430, binding = 2) readonly buffer FaceNormals { float faceNormals[]; };
+layout(std430, binding = 3) readonly buffer Welded { int welded[]; };
+layout(std430, binding = 4) readonly buffer Offsets { int offsets[]; };
+layout(std430, binding = 5) readonly buffer Triangles { int triangles[]; };
+layout(std430, binding = 6) writeonly buffer Normals { float normals[]; };
+
+uniform uint numVertices;
+
+void main()
+{
+	uint v = gl_GlobalInvocationID.x;
+	if (v >= numVertices) return;
+
+	int w = welded[v];
+	vec3 n = vec3(0.0);
+	for (int j = offsets[w]; j < offsets[w + 1]; j++)
+	{
+		int t = triangles[j];
+		n += vec3(faceNormals[3 * t], faceNormals[3 * t + 1], faceNormals[3 * t + 2]);
+	}
+	if (dot(n, n) > 0.0) n = normalize(n);
+	normals[3 * v] = n.x;
+	normals[3 * v + 1] = n.y;
+	normals[3 * v + 2] = n.z;
+}
@@ -9,6 +9,11 @@
 #include "Application.hpp"
 #include <iostream>
 #include <string>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <mutex>
 #include <GLFW/glfw3.h>
 #include "glm/glm.hpp"
 #include "glm/gtc/matrix_transform.hpp"
@@ -17,21 +22,37 @@
 #include <tiny_obj_loader.h>
 #include <SOIL.h>
 #include "XRShaderUtils.hpp"
+#include "FileUtils.hpp"
+#include "RigFile.hpp"
+#include "ThreadPool.hpp"
+#include "ObjParser.hpp"
+#include "MeshOptimizer.hpp"
+#include "BlendShapes.hpp"
+#include "FileWatcher.hpp"
+#include "BlendEngine.hpp"
+#include "BlendSelector.hpp"
+#include "MeshNormals.hpp"
+#include "SimdKernels.hpp"
 #include "../imgui/imgui.h"
 #include "../imgui/imgui_impl_glfw_gl3.h"
 
-#define NUM_BLENDSHAPE 6
-
 namespace Application
 {
 #pragma region variables
 
     /*constants*/
     static const char* ObjFileName          = "res/model/humanHead/head-reference.obj";
+    static const char* rigFileName          = "res/model/humanHead/head.rig";
     static const char* textureFileName      = "res/model/humanHead/headTexture.jpg";
+    static const char* deltasBufferShaderName  = "res/shader/deltasBuffer.glsl";
+    static const char* deltasTextureShaderName = "res/shader/deltasTexture.glsl";
+    static const char* blendShapesShaderName = "res/shader/blendShapes.glsl";
     static const char* vertexShaderName     = "res/shader/defaultShader.vs.glsl";
     static const char* fragmentShaderName   = "res/shader/defaultShader.fs.glsl";
-    static const char* blendShapesFileNames[NUM_BLENDSHAPE] =
+    static const char* faceNormalsShaderName   = "res/shader/faceNormals.cs.glsl";
+    static const char* vertexNormalsShaderName = "res/shader/vertexNormals.cs.glsl";
+    static const char* blendShaderName      = "res/shader/blend.cs.glsl";
+    static const char* blendShapesFileNames[] =
     {
         "res/model/humanHead/head-01-anger.obj",
         "res/model/humanHead/head-02-cry.obj",
@@ -39,10 +60,11 @@ namespace Application
         "res/model/humanHead/head-04-grin.obj",
         "res/model/humanHead/head-05-laugh.obj",
         "res/model/humanHead/head-06-rage.obj",
-        //"res/model/humanHead/head-07-sad.obj",
-        //"res/model/humanHead/head-08-smile.obj",
-        //"res/model/humanHead/head-09-surprise.obj",
+        "res/model/humanHead/head-07-sad.obj",
+        "res/model/humanHead/head-08-smile.obj",
+        "res/model/humanHead/head-09-surprise.obj",
     };
+    static const int NUM_BLENDSHAPE = (int)(sizeof(blendShapesFileNames) / sizeof(blendShapesFileNames[0]));
     static const float objScale = 0.12f;
     
     /*application*/
@@ -51,34 +73,88 @@ namespace Application
     static void loadResources();
 	static bool GUIready = false;
 
+	/*loading, done by a background task that hands its results to the render thread*/
+	enum LoadEvent { LOAD_TEXTURE, LOAD_NEUTRAL, LOAD_TARGET, LOAD_FAILED, LOAD_RELOADED, LOAD_FACTORED };
+	struct LoadItem
+	{
+		LoadEvent event;
+		int target;                         //for LOAD_TARGET and LOAD_RELOADED
+	};
+	static std::mutex loadMutex;
+	static std::deque<LoadItem> loadQueue;  //guarded by loadMutex
+	static std::string loadError;           //written before LOAD_FAILED is queued
+	static ThreadPool::TaskGroup loader;
+	static int loadProgress = 0;            //items handled by the render thread, out of NUM_BLENDSHAPE + 2
+	static bool neutralLoaded = false;
+	static bool targetLoaded[NUM_BLENDSHAPE] = { false };
+	static void decodeTexture();
+	static void postLoad(LoadEvent event, int target);
+	static void failLoad(const std::string& error);
+	static void processLoadQueue();
+
+	/*reloading of the targets edited while the application runs*/
+	static FileWatcher::Watch* rigWatch = NULL;
+	static std::mutex reloadMutex;                          //serializes prepareReload
+	static bool reloading[NUM_BLENDSHAPE] = { false };      //a reload task is running for the target
+	static bool reloadAgain[NUM_BLENDSHAPE] = { false };    //and the file was written again since
+	static std::chrono::steady_clock::time_point reloadStart[NUM_BLENDSHAPE];
+	static std::vector<float> reloadedDeltas[NUM_BLENDSHAPE];   //positions then normals, from the reload task
+	static std::vector<float> targetDeltas[NUM_BLENDSHAPE];     //the reloaded deltas in use
+	static void pollRig();
+	static void startReload(int i);
+	static bool reloadTarget(int i);
+	static bool prepareReload(std::string& err);
+
 	/*Graphics User Interface*/
 	static void initGUI();
 	static void renderGUI();
 	static void shutdownGUI();
     
     /*data*/
-	static GLfloat* positions = NULL;
-	static GLfloat* texcoords = NULL;
-	static GLfloat* normals   = NULL;
+	static const GLfloat* positions = NULL;
+	static const GLfloat* texcoords = NULL;
+	static const GLfloat* normals   = NULL;
     static int size_positions = 0;
 	static int size_normals = 0;
     static int size_texcoords = 0;
+	static int num_indices = 0;
 	bool hasTC = true; //has texture coordinates?
+	static RigFile::Rig rig;                //arrays point into the mapped rig file, or the compiled arrays
+	static FileUtils::MappedFile rigFile;
+	static ObjParser::Mesh compiledNeutral; //the rig when it was compiled by this run
+	static std::vector<float> compiledPositions;
+	static std::vector<float> compiledNormals;
+	static std::vector<unsigned int> compiledRemap;   //from the vertices of compiledNeutral.sources to the rig
+	static unsigned char* textureImage = NULL;
+	static int textureWidth = 0, textureHeight = 0, textureChannels = 0;
     
     /*shader*/
-    static GLuint program = 0;
+    static XRShaderUtils::Program program;
 	static GLuint vao = 0;
 	static GLuint vbo_positions = 0;
 	static GLuint vbo_normals = 0;
 	static GLuint vbo_texcoords = 0;
+	static GLuint ebo = 0;
 	static GLuint texture = 0;
-    static void loadObj();
+    static void loadRig();
+    static void compileRig(const char* const* sources, int num_sources);
+    static void optimizeNeutral(ObjParser::Mesh& neutral, std::vector<unsigned int>& remap);
+    static bool computeDeltas(const char* source, const ObjParser::Mesh& neutral, const std::vector<unsigned int>& remap,
+        float* bs_positions, float* bs_normals, std::string& err);
     static void loadShader();
+    static void initUniformBlocks();
 	static void initData();
     static void initVBOs();
-    static void initVAO();
+    static void initVAO(GLuint& array, GLuint position_buffer, GLuint normal_buffer);
     static void loadTexture();
     static void initBlendShapes();
+    static void buildSparseTargets();
+    static void buildSparseTarget(int i);
+    static void uploadBlendShapes();
+    static void uploadBlendShape(int i);
+    static GLuint packBlendShape(int i, std::vector<GLuint>& words);
+    static bool deltaNormals();
+    static void updateDeltaNormals();
 
 	/*lighting*/
 	static glm::vec3 lightDir(-0.57735, -0.57735, -0.57735);
@@ -86,11 +162,164 @@ namespace Application
 	static float diffusef  = 0.4f;
 	static float specularf = 0.8f;
 	static float shininessf = 30.f;
+
+	/*uniform blocks of the shaders, besides Weights*/
+	struct FrameConstants                   //Frame block of the shaders, in the std140 layout
+	{
+		glm::mat4 m2w;
+		glm::mat4 w2v;
+		glm::mat4 persp;
+		glm::vec3 eyepos;
+		GLfloat padding0;
+		glm::vec3 light;
+		GLfloat padding1;
+	};
+	struct MaterialConstants                //Material block of the fragment shader, in the std140 layout
+	{
+		glm::vec3 ambient;
+		GLfloat padding0;
+		glm::vec3 diffuse;
+		GLfloat padding1;
+		glm::vec3 specular;
+		GLfloat delta;
+		GLint hasTexture;
+		GLfloat padding2[3];
+	};
+	static GLuint ubo_frame = 0;            //written once per frame
+	static GLuint ubo_material = 0;         //written when the lighting or the texture changes
+	static MaterialConstants uploadedMaterial;
+	static const GLuint frameBinding = 1;   //binding points of ubo_frame and ubo_material
+	static const GLuint materialBinding = 2;
+
+	/*the uniforms of blendShapes.glsl, located once in every program that includes it*/
+	struct BlendLocations
+	{
+		GLint numActive;
+		GLint numVertices;
+		GLint deltaFormat;
+		GLint deltaNormals;
+	};
+	static BlendLocations programLocations;
+	static BlendLocations locateBlend(const XRShaderUtils::Program& reflected);
+	static void setBlendUniforms(const BlendLocations& locations, int numActive);
+	static void bindBlocks(GLuint program);
     
     /*blend shapes*/
 	static float weights[NUM_BLENDSHAPE] = { 0 };
-	static GLuint vbo_bs_positions[NUM_BLENDSHAPE];
-	static GLuint vbo_bs_normals[NUM_BLENDSHAPE];
+	static bool computeShaders = false;     //a 4.3 context, else the deltas are read through tbo_deltas and nothing is computed
+	static GLuint ssbo_deltas = 0;          //the deltas of every target, read by the vertex shader
+	static GLuint tbo_deltas = 0;           //buffer texture of ssbo_deltas without computeShaders, see deltasTexture.glsl
+	static GLuint ubo_weights = 0;          //the Weights block of the vertex shader
+	static int uploadedFormat = 0;          //DeltaFormat of ssbo_deltas, 0 before the first upload
+	static bool uploadedNormals = true;     //ssbo_deltas holds the normal deltas as well, see deltaNormals
+	static GLuint deltaOffsets[NUM_BLENDSHAPE] = { 0 };     //first word of every target in ssbo_deltas
+	static GLuint deltaCounts[NUM_BLENDSHAPE] = { 0 };      //vertices listed, rig.num_vertices for a dense target
+	static size_t deltaCapacities[NUM_BLENDSHAPE] = { 0 };  //words kept for every target
+	static GLint64 deltaBytes = 0;          //size of ssbo_deltas
+	static bool gpuDeltas = true;           //the deltas fit a shader storage block or a buffer texture, else only the CPU blends
+	static const int maxActiveTargets = 511;    //MAX_ACTIVE_TARGETS of blendShapes.glsl, 16 KB of weights
+	static const GLuint deltasBinding = 7;  //binding points of ssbo_deltas and ubo_weights
+	static const GLuint weightsBinding = 0;
+	static const GLuint deltasUnit = 1;     //texture unit of tbo_deltas, the texture of the mesh is on 0
+	static void bindDeltas();
+	static_assert(NUM_BLENDSHAPE <= maxActiveTargets, "too many targets for the Weights block of the vertex shader");
+	struct ActiveTarget                     //ActiveTarget of blendShapes.glsl, in the std140 layout
+	{
+		glm::vec3 position_weight;
+		GLuint offset;
+		glm::vec3 normal_weight;
+		GLuint count;
+	};
+	static_assert(sizeof(ActiveTarget) == 32, "ActiveTarget does not match its std140 layout");
+	static int gpuActiveTargets = 0;        //targets in the last Weights block
+	static int uploadWeights();
+	static const float* targetPositions[NUM_BLENDSHAPE];    //dense deltas of every target, in the rig or reloaded
+	static const float* targetNormals[NUM_BLENDSHAPE];
+	static BlendShapes::SparseTarget sparseTargets[NUM_BLENDSHAPE];
+	static float deltaEpsilon = 0.0f;       //deltas not longer than this are dropped, in model units; 0 is lossless
+	static float sparseKept = 1.0f;         //fraction of the deltas kept
+	static float sparseMaxError = 0.0f;     //longest position delta dropped
+	static float sparseMaxNormalError = 0.0f;
+	static BlendShapes::QuantizedTarget quantizedTargets[NUM_BLENDSHAPE];
+	enum DeltaFormat
+	{
+		DELTAS_FLOAT = 1,
+		DELTAS_HALF,        //half floats, converted to floats by the vertex fetch
+		DELTAS_SHORT,       //normalized integers decoded by the uniforms, see quantizedTargets
+		DELTAS_BYTE
+	};
+	static int deltaFormat = DELTAS_FLOAT;  //encoding of the deltas in the vertex buffers
+	static float deltaErrors[NUM_BLENDSHAPE] = { 0 };   //largest position error of the encoded deltas of every target
+	static float quantizedMaxError = 0.0f;  //largest of deltaErrors
+	enum BlendMode
+	{
+		BLEND_VERTEX,       //in the vertex shader, for every vertex drawn
+		BLEND_CPU,          //with BlendEngine into vbo_positions / vbo_normals
+		BLEND_COMPUTE,      //with blend.cs.glsl into vbo_positions / vbo_normals, when the weights change
+		BLEND_FEEDBACK      //in the vertex shader, captured into vbo_feedback when the weights change
+	};
+	static int blendMode = BLEND_VERTEX;
+	static BlendEngine::Rig blendRig;       //the sparse targets, expanded; released while the low rank basis is blended
+	static BlendEngine::Incremental blended;
+	static bool incrementalBlend = true;    //apply only the weight changes to the last blended mesh
+	static int cpuBlendTargets = 0;         //targets blended in the last frame
+	static bool autoKernel = true;          //pick the dense or sparse kernel every frame when not incremental
+	static int blendKernel = BlendSelector::DENSE;
+	static BlendSelector::Costs blendCosts; //measured when the CPU blend is first enabled
+	static float cpuBlendTime = 0.0f;       //milliseconds
+	static bool halfPrecision = false;      //blend half float deltas, BlendEngine::setHalfPrecision
+	static bool validateHalf = false;       //compare every half precision blend to the float one
+	static float halfPositionError = 0.0f;  //largest difference found by the last comparison
+	static float halfNormalError = 0.0f;
+	static bool lowRank = false;            //blend the principal components of the targets instead of the targets
+	static float lowRankTolerance = 0.05f;  //largest position error of the components kept, in model units
+	static bool lowRankDirty = true;        //the targets changed since the last factorization started
+	static bool factoring = false;          //a factorization runs on the loader
+	static BlendShapes::LowRankBasis lowRankBasis;  //the errors of every rank, picked from lowRankTolerance, no meshes
+	static BlendEngine::Rig basisRig;       //the first components of lowRankBasis as targets, none before the first factorization
+	static BlendShapes::LowRankBasis factoredBasis; //written by the loader, swapped in on LOAD_FACTORED
+	static BlendEngine::Rig factoredRig;
+	static void blendOnCPU();
+	static void setBlendMode(int mode);
+	static void createBlendRig();
+	static void startFactorize();
+
+	/*blending on the GPU once, into vertex buffers drawn until the weights change*/
+	static float cachedWeights[NUM_BLENDSHAPE] = { 0 };    //weights of the last compute or feedback blend
+	static bool cacheDirty = true;          //the deltas, the mode or the normal mode changed since then
+	static int cacheUpdates = 0;            //compute or feedback blends run, skipped while the weights stay the same
+	static bool cacheValid();
+	static XRShaderUtils::Program blendProgram;    //the compute shader and the neutral buffers are created on first use
+	static BlendLocations blendProgramLocations;
+	static GLuint ssbo_neutral[2] = { 0 };  //positions, normals
+	static void initBlendShader();
+	static void blendOnGPU();
+	static XRShaderUtils::Program feedbackProgram; //the vertex shader alone, capturing m_position and m_normal
+	static BlendLocations feedbackLocations;
+	static GLuint vbo_feedback[2] = { 0 };  //positions, normals; drawn with vao_feedback
+	static GLuint vao_feedback = 0;
+	static void initFeedback();
+	static void blendWithFeedback();
+
+	/*normals of the CPU and compute blends*/
+	enum NormalMode
+	{
+		NORMALS_BLENDED,    //blended from the normal deltas
+		NORMALS_CPU,        //recomputed from the blended positions with MeshNormals
+		NORMALS_GPU         //recomputed by compute shaders reading vbo_positions
+	};
+	static int normalMode = NORMALS_BLENDED;
+	static MeshNormals::Adjacency adjacency;    //built with the neutral mesh
+	static std::vector<float> faceNormals;
+	static XRShaderUtils::Program faceNormalsProgram;  //the compute shaders and buffers are created on first use
+	static XRShaderUtils::Program vertexNormalsProgram;
+	static GLint numTrianglesLocation = -1;     //of faceNormalsProgram
+	static GLint numNormalsLocation = -1;       //numVertices of vertexNormalsProgram
+	static GLuint ssbo_faceNormals = 0;
+	static GLuint ssbo_adjacency[3] = { 0 };    //welded, offsets, triangles
+	static float normalTime = 0.0f;             //milliseconds, CPU time only for the GPU variant
+	static void initNormalShaders();
+	static void recomputeNormalsOnGPU();
     
     /*camera*/
     static float camera_speed;
@@ -112,16 +341,12 @@ namespace Application
     void appSetup()
     {
         std::cout << "Setting up application..." << std::endl;
+		computeShaders = GLEW_VERSION_4_3 != 0;
+		if (!computeShaders) std::cout << "- OpenGL " << glGetString(GL_VERSION) << ", no compute blend nor GPU normals" << std::endl;
         
         std::cout << "- Load Resources" << std::endl;
         loadResources();
         
-        std::cout << "- Initializing Data" << std::endl;
-        initData();
-        
-        std::cout << "- Preparing Blendshapes" << std::endl;
-        initBlendShapes();
-        
         std::cout << "- Initialize Camera..." << std::endl;
         initCamera();
         
@@ -130,8 +355,13 @@ namespace Application
     
     void appLoop()
     {
+        processLoadQueue();
+        pollRig();
         updateCamera();
-        render();
+        if (neutralLoaded && blendMode == BLEND_CPU) blendOnCPU();
+        if (neutralLoaded && blendMode == BLEND_COMPUTE) blendOnGPU();
+        if (neutralLoaded && blendMode == BLEND_FEEDBACK) blendWithFeedback();
+        if (neutralLoaded) render();
 		renderGUI();
     }
     
@@ -139,14 +369,38 @@ namespace Application
     {
 		shutdownGUI();
 
-		if (positions != NULL) { free(positions); }
-		if (texcoords != NULL) { free(texcoords); }
-		if (normals != NULL)   { free(normals); }
+		loader.wait();
+		FileWatcher::close(rigWatch);
+		rigWatch = NULL;
+		BlendEngine::destroy(blended);
+		BlendEngine::destroy(blendRig);
+		BlendEngine::destroy(basisRig);
+		BlendEngine::destroy(factoredRig);
+		SOIL_free_image_data(textureImage);
+		textureImage = NULL;
+
+		FileUtils::unmapFile(rigFile);
+		positions = texcoords = normals = NULL;
         glDeleteBuffers     (1, &vbo_positions);
         glDeleteBuffers     (1, &vbo_texcoords);
 		glDeleteBuffers		(1, &vbo_normals);
+		glDeleteBuffers		(1, &ebo);
         glDeleteTextures	(1, &texture);
-		glDeleteBuffers(NUM_BLENDSHAPE, vbo_bs_positions);
+		glDeleteBuffers(1, &ssbo_deltas);
+		glDeleteTextures(1, &tbo_deltas);
+		glDeleteBuffers(1, &ubo_weights);
+		glDeleteBuffers(1, &ssbo_faceNormals);
+		glDeleteBuffers(3, ssbo_adjacency);
+		glDeleteProgram(faceNormalsProgram.id);
+		glDeleteProgram(vertexNormalsProgram.id);
+		glDeleteBuffers(2, ssbo_neutral);
+		glDeleteProgram(blendProgram.id);
+		glDeleteBuffers(2, vbo_feedback);
+		glDeleteProgram(feedbackProgram.id);
+		glDeleteBuffers(1, &ubo_frame);
+		glDeleteBuffers(1, &ubo_material);
+		glDeleteProgram(program.id);
+		glDeleteVertexArrays(1, &vao_feedback);
 		glDeleteVertexArrays(1, &vao);
     }
 
@@ -160,45 +414,45 @@ namespace Application
     void render()
     {
         //bind
-        glUseProgram(program);
-        glBindVertexArray(vao);
+        glUseProgram(program.id);
+        glBindVertexArray(blendMode == BLEND_FEEDBACK ? vao_feedback : vao);
         glBindTexture(GL_TEXTURE_2D, texture);
         
-        //set uniforms - for transformation
-		GLuint m2wlocation = glGetUniformLocation(program, "m2w");
-		glm::mat4 m2w = glm::scale(glm::mat4(), glm::vec3(objScale, objScale, objScale));
+        //set uniforms - for transformation and lighting, in one write
+        FrameConstants frame = FrameConstants();
+		frame.m2w = glm::scale(glm::mat4(), glm::vec3(objScale, objScale, objScale));
 		//rotate = glm::rotate(rotate, glm::radians(0.2f), glm::vec3(0,1,0)); //rotate for fun
-		m2w = m2w * rotate;
-		glUniformMatrix4fv(m2wlocation, 1, GL_FALSE, glm::value_ptr(m2w));
-        GLuint w2vlocation =  glGetUniformLocation(program, "w2v");
-		glUniformMatrix4fv(w2vlocation, 1, GL_FALSE, glm::value_ptr(getWorld2View()));
-        GLuint persplocation = glGetUniformLocation(program, "persp");
-        glUniformMatrix4fv(persplocation, 1, GL_FALSE, glm::value_ptr(getPerspective()));
+		frame.m2w = frame.m2w * rotate;
+		frame.w2v = getWorld2View();
+		frame.persp = getPerspective();
+		frame.eyepos = camera_position;
+		frame.light = lightDir;
+		glBindBuffer(GL_UNIFORM_BUFFER, ubo_frame);
+		glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(frame), &frame);
+
+		//set uniforms - for the material and the texture, only when they change
+		MaterialConstants material = MaterialConstants();
+		material.ambient = glm::vec3(ambientf);
+		material.diffuse = glm::vec3(diffusef);
+		material.specular = glm::vec3(specularf);
+		material.delta = shininessf;
+		material.hasTexture = hasTC && texture != 0;
+		if (memcmp(&material, &uploadedMaterial, sizeof(material)) != 0)
+		{
+			glBindBuffer(GL_UNIFORM_BUFFER, ubo_material);
+			glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(material), &material);
+			uploadedMaterial = material;
+		}
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
         
-        //set uniforms - for blending shapes
-        GLuint weightsLocation = glGetUniformLocation(program,"weights");
-        glUniform1fv(weightsLocation, NUM_BLENDSHAPE, weights);
-
-		//set uniforms - for texture
-		GLuint hasTextureLocation = glGetUniformLocation(program, "hasTexture");
-		glUniform1d(hasTextureLocation, hasTC);
-
-		//set uniforms - for lighting
-		GLuint lightlocation = glGetUniformLocation(program, "light");
-		glUniform3f(lightlocation, lightDir.x, lightDir.y, lightDir.z);
-		GLuint eyeposlocation = glGetUniformLocation(program, "eyepos");
-		glUniform3f(eyeposlocation, camera_position.x, camera_position.y, camera_position.z);
-		GLuint ambientlocation = glGetUniformLocation(program, "ambient");
-		glUniform3f(ambientlocation, ambientf, ambientf, ambientf);
-		GLuint diffuselocation = glGetUniformLocation(program, "diffuse");
-		glUniform3f(diffuselocation, diffusef, diffusef, diffusef);
-		GLuint specularlocation = glGetUniformLocation(program, "specular");
-		glUniform3f(specularlocation, specularf, specularf, specularf);
-		GLuint deltalocation = glGetUniformLocation(program, "delta");
-		glUniform1f(deltalocation, shininessf);
+        //set uniforms - for blending shapes, the vertex buffers are already blended by the other modes
+        int numActive = blendMode == BLEND_VERTEX ? uploadWeights() : 0;
+        glBindBufferBase(GL_UNIFORM_BUFFER, weightsBinding, ubo_weights);
+        bindDeltas();
+        setBlendUniforms(programLocations, numActive);
 
         //drawcall
-        glDrawArrays(GL_TRIANGLES, 0, size_positions/3);
+        glDrawElements(GL_TRIANGLES, num_indices, GL_UNSIGNED_INT, 0);
         
         //unbind
         glUseProgram(0);
@@ -208,13 +462,226 @@ namespace Application
     }
     
     /**
-     * load resources including obj model file, texture file and shaders.
+     * Load the shaders, and start loading the texture and the rig in the
+     * background. They are handed over to the render thread piece by piece
+     * through the load queue, see processLoadQueue.
      */
     void loadResources()
     {
 		loadShader();
-		loadTexture();
-        loadObj();
+		loader.run(decodeTexture);
+		loader.run(loadRig);
+    }
+
+    /* runs on the loader, the texture is created by the render thread */
+    void decodeTexture()
+    {
+		textureImage = SOIL_load_image(textureFileName, &textureWidth, &textureHeight, &textureChannels, SOIL_LOAD_AUTO);
+		postLoad(LOAD_TEXTURE, -1);
+    }
+
+    void postLoad(LoadEvent event, int target)
+    {
+		LoadItem item = { event, target };
+		std::lock_guard<std::mutex> lock(loadMutex);
+		loadQueue.push_back(item);
+    }
+
+    void failLoad(const std::string& error)
+    {
+		{
+			std::lock_guard<std::mutex> lock(loadMutex);
+			loadError = error;
+		}
+		postLoad(LOAD_FAILED, -1);
+    }
+
+    /**
+     * Create the GL objects for whatever the loader has finished since the
+     * last frame. The neutral mesh is drawn as soon as it arrives, each
+     * target becomes usable when its deltas are uploaded.
+     */
+    void processLoadQueue()
+    {
+		std::deque<LoadItem> items;
+		{
+			std::lock_guard<std::mutex> lock(loadMutex);
+			items.swap(loadQueue);
+		}
+		for (size_t i = 0; i < items.size(); i++)
+		{
+			switch (items[i].event)
+			{
+			case LOAD_TEXTURE:
+				loadTexture();
+				break;
+			case LOAD_NEUTRAL:
+				positions      = rig.positions;
+				normals        = rig.normals;
+				texcoords      = rig.texcoords;
+				hasTC          = texcoords != NULL;
+				size_positions = rig.num_vertices * 3;
+				size_normals   = rig.num_vertices * 3;
+				size_texcoords = hasTC ? rig.num_vertices * 2 : 0;
+				num_indices    = rig.num_indices;
+				for (int j = 0; j < NUM_BLENDSHAPE; j++)
+				{
+					targetPositions[j] = rig.bs_positions + size_positions * j;
+					targetNormals[j]   = rig.bs_normals + size_normals * j;
+				}
+				initData();
+				initBlendShapes();
+				MeshNormals::buildAdjacency(rig.indices, num_indices, positions, rig.num_vertices, adjacency);
+				neutralLoaded = true;
+				break;
+			case LOAD_TARGET:
+				targetLoaded[items[i].target] = true;
+				lowRankDirty = true;
+				buildSparseTarget(items[i].target);
+				uploadBlendShape(items[i].target);
+				break;
+			case LOAD_FAILED:
+			{
+				std::string error;
+				{
+					std::lock_guard<std::mutex> lock(loadMutex);
+					error = loadError;
+				}
+				std::cerr << error << std::endl;
+				exit(1);
+			}
+			case LOAD_RELOADED:
+			{
+				int t = items[i].target;
+				if (!reloadedDeltas[t].empty())
+				{
+					targetDeltas[t].swap(reloadedDeltas[t]);
+					targetPositions[t] = &targetDeltas[t][0];
+					targetNormals[t]   = &targetDeltas[t][size_positions];
+					lowRankDirty = true;
+					buildSparseTarget(t);
+					uploadBlendShape(t);
+					std::cout << "-- Reloaded " << blendShapesFileNames[t] << " in " << std::chrono::duration_cast<std::chrono::milliseconds>(
+						std::chrono::steady_clock::now() - reloadStart[t]).count() << " ms" << std::endl;
+				}
+				reloading[t] = false;
+				if (reloadAgain[t] && !factoring) startReload(t);
+				continue;
+			}
+			case LOAD_FACTORED:
+			{
+				std::swap(lowRankBasis, factoredBasis);
+				factoredBasis = BlendShapes::LowRankBasis();
+				BlendEngine::destroy(basisRig);
+				basisRig = factoredRig;
+				factoredRig = BlendEngine::Rig();
+				BlendEngine::setHalfPrecision(basisRig, halfPrecision);
+				BlendShapes::setRankForError(lowRankBasis, lowRankTolerance);
+				BlendEngine::invalidate(blended);
+				factoring = false;
+
+				//the reloads held back while the deltas were read
+				for (int t = 0; t < NUM_BLENDSHAPE; t++)
+					if (reloadAgain[t] && !reloading[t]) startReload(t);
+				continue;
+			}
+			}
+
+			if (++loadProgress == NUM_BLENDSHAPE + 2)
+			{
+				//without the room kept for the targets being loaded
+				uploadBlendShapes();
+				std::cout << "-- Loaded " << rig.num_vertices << " vertices and " << NUM_BLENDSHAPE << " targets" << std::endl;
+				std::cout << "-- Sparse deltas with epsilon " << deltaEpsilon << ": " << sparseKept * 100.0f
+					<< "% kept, max error " << sparseMaxError << " (position) " << sparseMaxNormalError << " (normal), "
+					<< deltaBytes << " bytes on the GPU" << std::endl;
+
+				//from now on edited targets are reloaded
+				const char* sources[NUM_BLENDSHAPE + 1];
+				sources[0] = ObjFileName;
+				for (int j = 0; j < NUM_BLENDSHAPE; j++) sources[j + 1] = blendShapesFileNames[j];
+				rigWatch = FileWatcher::open(sources, NUM_BLENDSHAPE + 1);
+				if (rigWatch == NULL) std::cerr << "Cannot watch the rig files, edited targets will not be reloaded" << std::endl;
+			}
+		}
+    }
+
+    /* start a reload for the targets whose file was written */
+    void pollRig()
+    {
+		std::vector<int> changed;
+		FileWatcher::poll(rigWatch, changed);
+		for (size_t i = 0; i < changed.size(); i++)
+		{
+			if (changed[i] == 0)
+			{
+				std::cout << "-- " << ObjFileName << " changed, restart to reload the neutral mesh" << std::endl;
+				continue;
+			}
+			//a factorization may be reading the deltas a reload would overwrite
+			int t = changed[i] - 1;
+			if (reloading[t] || factoring) reloadAgain[t] = true;
+			else startReload(t);
+		}
+    }
+
+    /**
+     * Parse a target again and recompute its deltas on the loader. The
+     * result is swapped in by processLoadQueue, one reload runs per target.
+     */
+    void startReload(int i)
+    {
+		reloading[i] = true;
+		reloadAgain[i] = false;
+		reloadStart[i] = std::chrono::steady_clock::now();
+		loader.run([i]() {
+			if (!reloadTarget(i)) reloadedDeltas[i].clear();
+			postLoad(LOAD_RELOADED, i);
+		});
+    }
+
+    bool reloadTarget(int i)
+    {
+		std::string err;
+		bool ok;
+		{
+			std::lock_guard<std::mutex> lock(reloadMutex);
+			ok = prepareReload(err);
+		}
+		if (ok)
+		{
+			reloadedDeltas[i].resize(size_positions + size_normals);
+			ok = computeDeltas(blendShapesFileNames[i], compiledNeutral, compiledRemap,
+				&reloadedDeltas[i][0], &reloadedDeltas[i][size_positions], err);
+		}
+		if (!err.empty()) std::cerr << err << std::endl;
+		if (!ok) std::cerr << "Keeping the previous deltas of " << blendShapesFileNames[i] << std::endl;
+		return ok;
+    }
+
+    /**
+     * Targets are read in the vertex order of the neutral OBJ and remapped
+     * to the order of the rig. When the rig was mapped rather than compiled,
+     * rebuild both the first time a target is reloaded, which only works as
+     * long as the neutral mesh is the one the rig was compiled from.
+     */
+    bool prepareReload(std::string& err)
+    {
+		if (!compiledRemap.empty()) return true;
+
+		ObjParser::Mesh& neutral = compiledNeutral;
+		if (!ObjParser::loadMesh(ObjFileName, neutral, err) || neutral.normals.empty() || neutral.indices.empty())
+			return false;
+		std::vector<unsigned int> remap;
+		optimizeNeutral(neutral, remap);
+		if (neutral.positions.size() != (size_t)size_positions
+			|| memcmp(&neutral.positions[0], rig.positions, sizeof(float) * size_positions) != 0)
+		{
+			err += std::string(ObjFileName) + " changed since the rig was compiled, restart to reload it\n";
+			return false;
+		}
+		compiledRemap.swap(remap);
+		return true;
     }
     
     /**
@@ -223,88 +690,262 @@ namespace Application
     void initData()
     {
         initVBOs();
-        initVAO();
+        initVAO(vao, vbo_positions, vbo_normals);
     }
     
     /* Load, compile and link the shader program*/
     void loadShader()
     {
         GLuint shaders[2];
-        shaders[0] = XRShaderUtils::loadShader(vertexShaderName, GL_VERTEX_SHADER, true);
+        const char* vertexShaderNames[3] = { computeShaders ? deltasBufferShaderName : deltasTextureShaderName,
+            blendShapesShaderName, vertexShaderName };
+        shaders[0] = XRShaderUtils::loadShader(vertexShaderNames, 3, GL_VERTEX_SHADER, true);
         shaders[1] = XRShaderUtils::loadShader(fragmentShaderName, GL_FRAGMENT_SHADER, true);
-        program = XRShaderUtils::linkShaderProgram(shaders, 2, true);
+        XRShaderUtils::reflectProgram(XRShaderUtils::linkShaderProgram(shaders, 2, true), program);
+        programLocations = locateBlend(program);
+        bindBlocks(program.id);
+        initUniformBlocks();
     }
+
+    /**
+     * Create the Frame and Material blocks, sized from the program in case
+     * the shaders and the structs went apart, and bind them for good.
+     */
+    void initUniformBlocks()
+    {
+		GLint frame_size = XRShaderUtils::uniformBlockSize(program, "Frame");
+		GLint material_size = XRShaderUtils::uniformBlockSize(program, "Material");
+		if (frame_size > (GLint)sizeof(FrameConstants) || material_size > (GLint)sizeof(MaterialConstants))
+		{
+			std::cerr << "The Frame and Material blocks of the shaders do not match the application" << std::endl;
+			exit(1);
+		}
+
+		glGenBuffers(1, &ubo_frame);
+		glBindBuffer(GL_UNIFORM_BUFFER, ubo_frame);
+		glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameConstants), NULL, GL_DYNAMIC_DRAW);
+		glGenBuffers(1, &ubo_material);
+		glBindBuffer(GL_UNIFORM_BUFFER, ubo_material);
+		uploadedMaterial = MaterialConstants();
+		glBufferData(GL_UNIFORM_BUFFER, sizeof(MaterialConstants), &uploadedMaterial, GL_DYNAMIC_DRAW);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+		glBindBufferBase(GL_UNIFORM_BUFFER, frameBinding, ubo_frame);
+		glBindBufferBase(GL_UNIFORM_BUFFER, materialBinding, ubo_material);
+	}
+
+    BlendLocations locateBlend(const XRShaderUtils::Program& reflected)
+    {
+		BlendLocations locations;
+		locations.numActive = XRShaderUtils::uniformLocation(reflected, "numActive");
+		locations.numVertices = XRShaderUtils::uniformLocation(reflected, "numVertices");
+		locations.deltaFormat = XRShaderUtils::uniformLocation(reflected, "deltaFormat");
+		locations.deltaNormals = XRShaderUtils::uniformLocation(reflected, "deltaNormals");
+		return locations;
+	}
+
+    /* for the program in use */
+    void setBlendUniforms(const BlendLocations& locations, int numActive)
+    {
+		glUniform1i(locations.numActive, numActive);
+		glUniform1i(locations.numVertices, rig.num_vertices);
+		glUniform1i(locations.deltaFormat, uploadedFormat);
+		glUniform1i(locations.deltaNormals, uploadedNormals ? 1 : 0);
+	}
+
+    /**
+     * Bind the uniform blocks a program has to their binding points, and its
+     * buffer texture of the deltas to deltasUnit: the shaders are 3.3 where
+     * they may run without computeShaders, with no binding qualifiers.
+     */
+    void bindBlocks(GLuint program)
+    {
+		const char* names[3] = { "Weights", "Frame", "Material" };
+		const GLuint bindings[3] = { weightsBinding, frameBinding, materialBinding };
+		for (int i = 0; i < 3; i++)
+		{
+			GLuint index = glGetUniformBlockIndex(program, names[i]);
+			if (index != GL_INVALID_INDEX) glUniformBlockBinding(program, index, bindings[i]);
+		}
+		GLint location = glGetUniformLocation(program, "deltaTexture");
+		if (location < 0) return;
+		glUseProgram(program);
+		glUniform1i(location, deltasUnit);
+		glUseProgram(0);
+	}
+
+    /* for the blend programs, as a storage buffer or a buffer texture */
+    void bindDeltas()
+    {
+		if (computeShaders)
+		{
+			glBindBufferBase(GL_SHADER_STORAGE_BUFFER, deltasBinding, ssbo_deltas);
+			return;
+		}
+		glActiveTexture(GL_TEXTURE0 + deltasUnit);
+		glBindTexture(GL_TEXTURE_BUFFER, tbo_deltas);
+		glActiveTexture(GL_TEXTURE0);
+	}
     
     /**
-     * Load the OBJ model
+     * Map the compiled rig, or recompile it if any of the OBJ files it was
+     * built from has changed. Runs on the loader.
      */
-    void loadObj()
+    void loadRig()
     {
-        std::vector<tinyobj::shape_t> shapes;
-        std::vector<tinyobj::material_t> materials;
-        
-        //load obj file
+        //the neutral mesh followed by the blendshape targets
+        const char* sources[NUM_BLENDSHAPE + 1];
+        sources[0] = ObjFileName;
+        for (int i = 0; i < NUM_BLENDSHAPE; i++) sources[i + 1] = blendShapesFileNames[i];
+
+        if (RigFile::isUpToDate(rigFileName, sources, NUM_BLENDSHAPE + 1))
+        {
+            if (RigFile::open(rigFileName, rig, rigFile) && rig.num_targets == NUM_BLENDSHAPE && rig.indices != NULL)
+            {
+                postLoad(LOAD_NEUTRAL, -1);
+                for (int i = 0; i < NUM_BLENDSHAPE; i++) postLoad(LOAD_TARGET, i);
+                return;
+            }
+            FileUtils::unmapFile(rigFile);
+            std::cerr << "Cannot open rig file " << rigFileName << std::endl;
+        }
+
+        std::cout << "-- Compiling " << rigFileName << std::endl;
+        compileRig(sources, NUM_BLENDSHAPE + 1);
+    }
+
+    /**
+     * Parse the neutral and target OBJ files, compute the differences with the
+     * neutral expression and write everything into the rig file.
+     * sources[0] is the neutral mesh, the others are the targets in order.
+     * The targets must have the same vertices and triangles as the neutral
+     * mesh, so one index buffer serves all of them and deltas are stored
+     * once per unique vertex. The neutral mesh and then every target are
+     * handed to the render thread as soon as they are ready.
+     */
+    void compileRig(const char* const* sources, int num_sources)
+    {
+        //the neutral mesh defines the vertices and triangles of the rig
+        std::cout << "-- Reading " << sources[0] << std::endl;
+        ObjParser::Mesh& neutral = compiledNeutral;
         std::string err;
-        bool ret = tinyobj::LoadObj(shapes, materials, err, ObjFileName);
-        
+        bool loaded = ObjParser::loadMesh(sources[0], neutral, err);
         if (!err.empty()) { // `err` may contain warning message.
             std::cerr << err << std::endl;
         }
-        
-        if (!ret) {
-            exit(1);
+        if (!loaded) {
+            failLoad(std::string("Cannot load ") + sources[0]);
+            return;
         }
-        
-        //initialize positions and texcoords array
-        int numf = 0;
-        for (size_t i = 0; i < shapes.size(); i++)
+        if (neutral.indices.empty())
         {
-            numf += shapes[i].mesh.indices.size()/3;
-			if (shapes[i].mesh.texcoords.size() == 0) hasTC = false;
+            failLoad(std::string(sources[0]) + " has no triangles");
+            return;
         }
-        positions	   = (float*) malloc(sizeof(GLfloat) * numf * 9);
-		normals		   = (float*)malloc(sizeof(GLfloat)* numf * 9);
-		texcoords	   = (float*)malloc(sizeof(GLfloat)* numf * 6);
-        size_positions = numf * 9;
-		size_normals   = numf * 9;
-		size_texcoords = numf * 6;
-        
-        
-        //fill the positions and texcoords array
-        int count1 = 0;
-		int count2 = 0;
-        int count3 = 0;
-        for (size_t i = 0; i < shapes.size(); i++) {
-            
-            //make sure the data is good
-            assert((shapes[i].mesh.indices.size()   % 3) == 0);
-            assert((shapes[i].mesh.positions.size() % 3) == 0);
-            assert((shapes[i].mesh.texcoords.size() % 2) == 0);
-            
-            //for all the triangles
-            for (size_t f = 0; f < shapes[i].mesh.indices.size() / 3; f++) {
-                
-                //for all the 3 vertices
-                for (int viter = 0; viter < 3; viter ++)
-                {
-                    int vidx = shapes[i].mesh.indices[3*f+viter];
-                    positions[count1++] = shapes[i].mesh.positions[vidx*3 + 0];
-                    positions[count1++] = shapes[i].mesh.positions[vidx*3 + 1];
-                    positions[count1++] = shapes[i].mesh.positions[vidx*3 + 2];
-					normals  [count2++] = shapes[i].mesh.normals  [vidx*3 + 0];
-					normals  [count2++] = shapes[i].mesh.normals  [vidx*3 + 1];
-					normals  [count2++] = shapes[i].mesh.normals  [vidx*3 + 2];
-					if (hasTC)
-					{
-						texcoords[count3++] = shapes[i].mesh.texcoords[vidx*2 + 0];
-						texcoords[count3++] = shapes[i].mesh.texcoords[vidx*2 + 1];
-					}
-                }
+        if (neutral.normals.empty())
+        {
+            failLoad(std::string(sources[0]) + " has vertices without normals");
+            return;
+        }
+
+        std::vector<unsigned int>& remap = compiledRemap;
+        optimizeNeutral(neutral, remap);
+        size_t size = neutral.positions.size();
+        int num_vertices = (int)(size / 3);
+        int size_indices = (int)neutral.indices.size();
+
+        //the neutral mesh can be drawn while the targets load
+        int num_targets = num_sources - 1;
+        compiledPositions.assign(size * num_targets, 0.0f);
+        compiledNormals.assign(size * num_targets, 0.0f);
+        rig.num_vertices = num_vertices;
+        rig.num_indices  = size_indices;
+        rig.num_targets  = num_targets;
+        rig.positions    = &neutral.positions[0];
+        rig.normals      = &neutral.normals[0];
+        rig.texcoords    = neutral.texcoords.empty() ? NULL : &neutral.texcoords[0];
+        rig.indices      = &neutral.indices[0];
+        rig.bs_positions = &compiledPositions[0];
+        rig.bs_normals   = &compiledNormals[0];
+        postLoad(LOAD_NEUTRAL, -1);
+
+        //the targets are fingerprinted against it and only their attributes are read, concurrently
+        std::vector<std::string> obj_errors(num_targets);
+        std::vector<char> obj_loaded(num_targets, 0);
+        {
+            ThreadPool::TaskGroup group;
+            for (int i = 0; i < num_targets; i++)
+            {
+                std::cout << "-- Reading " << sources[i + 1] << std::endl;
+                group.run([&, i]() {
+                    obj_loaded[i] = computeDeltas(sources[i + 1], neutral, remap,
+                        &compiledPositions[size * i], &compiledNormals[size * i], obj_errors[i]);
+                    if (obj_loaded[i]) postLoad(LOAD_TARGET, i);
+                });
             }
+            group.wait();
+        }
+        bool matching = true;
+        for (int i = 0; i < num_targets; i++)
+        {
+            if (!obj_errors[i].empty()) {
+                std::cerr << obj_errors[i] << std::endl;
+            }
+            if (!obj_loaded[i]) matching = false;
+        }
+        if (!matching) {
+            failLoad("Cannot load the blendshape targets");
+            return;
+        }
+
+        //the compiled arrays stay in use, the file only saves the next start the parsing
+        if (!RigFile::write(rigFileName, rig, sources, num_sources))
+        {
+            std::cerr << "Cannot write rig file " << rigFileName << std::endl;
         }
     }
-    
-    
+
+    /**
+     * Reorder the triangles of the neutral mesh for the post-transform cache,
+     * then its vertices in order of first use. remap[v] is the new place of
+     * vertex v of the OBJ.
+     */
+    void optimizeNeutral(ObjParser::Mesh& neutral, std::vector<unsigned int>& remap)
+    {
+        int num_vertices = (int)(neutral.positions.size() / 3);
+        int size_indices = (int)neutral.indices.size();
+        float acmr = MeshOptimizer::averageCacheMissRatio(&neutral.indices[0], size_indices, num_vertices);
+        MeshOptimizer::optimizeVertexCache(&neutral.indices[0], size_indices, num_vertices);
+        MeshOptimizer::optimizeVertexFetch(&neutral.indices[0], size_indices, num_vertices, remap);
+        std::cout << "-- " << num_vertices << " vertices, " << size_indices / 3 << " triangles, ACMR "
+            << acmr << " -> " << MeshOptimizer::averageCacheMissRatio(&neutral.indices[0], size_indices, num_vertices)
+            << std::endl;
+        MeshOptimizer::remapVertices(&neutral.positions[0], num_vertices, 3, remap);
+        MeshOptimizer::remapVertices(&neutral.normals[0], num_vertices, 3, remap);
+        if (!neutral.texcoords.empty())
+            MeshOptimizer::remapVertices(&neutral.texcoords[0], num_vertices, 2, remap);
+    }
+
+    /**
+     * Read a target against the optimized neutral mesh and write its
+     * position and normal deltas in rig order. Safe to call from worker
+     * threads, errors are returned in err.
+     */
+    bool computeDeltas(const char* source, const ObjParser::Mesh& neutral, const std::vector<unsigned int>& remap,
+        float* bs_positions, float* bs_normals, std::string& err)
+    {
+        ObjParser::Mesh target;
+        if (!ObjParser::loadMeshAttributes(source, neutral, target, err)) return false;
+        int num_vertices = (int)(neutral.positions.size() / 3);
+        MeshOptimizer::remapVertices(&target.positions[0], num_vertices, 3, remap);
+        MeshOptimizer::remapVertices(&target.normals[0], num_vertices, 3, remap);
+
+        //compute the difference vectors
+        const SimdKernels::Table& kernels = SimdKernels::get();
+        kernels.subtract(&target.positions[0], &neutral.positions[0], bs_positions, neutral.positions.size());
+        kernels.subtract(&target.normals[0], &neutral.normals[0], bs_normals, neutral.normals.size());
+        return true;
+    }
+
     /**
      * Initialize all the Vertex Buffer Objects
      */
@@ -332,62 +973,102 @@ namespace Application
 			glBindBuffer(GL_ARRAY_BUFFER, vbo_normals);
 			glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat)*size_normals, normals, GL_STATIC_DRAW);
 		}
+		{
+			//for the indices, attached to the vao as element buffer in initVAO
+			glGenBuffers(1, &ebo);
+			glBindBuffer(GL_ARRAY_BUFFER, ebo);
+			glBufferData(GL_ARRAY_BUFFER, sizeof(GLuint)*num_indices, rig.indices, GL_STATIC_DRAW);
+		}
         
         glBindBuffer(GL_ARRAY_BUFFER, 0);
     }
     
     /**
      * Initialize Vertex Array Object, which represents the inputs to the
-     * vertex shader.
+     * vertex shader, for the neutral or the blended positions and normals.
      */
-    void initVAO()
+    void initVAO(GLuint& array, GLuint position_buffer, GLuint normal_buffer)
     {
         //initialize and bind the vao to the pipeline
-        glGenVertexArrays(1,&vao);
-		glBindVertexArray(vao);
+        glGenVertexArrays(1,&array);
+		glBindVertexArray(array);
 
 		//set up positions' attribute bindings
 		{
-			GLuint location = glGetAttribLocation(program, "vs_position");
-			glVertexAttribBinding(location, location);
-			glBindVertexBuffer(location, vbo_positions, 0, sizeof(GLfloat)* 3);
-			glVertexAttribFormat(location, 3, GL_FLOAT, GL_FALSE, 0);
+			GLuint location = XRShaderUtils::attribLocation(program, "vs_position");
+			glBindBuffer(GL_ARRAY_BUFFER, position_buffer);
+			glVertexAttribPointer(location, 3, GL_FLOAT, GL_FALSE, sizeof(GLfloat)* 3, 0);
 			glEnableVertexAttribArray(location);
 		}
 
 		//set up texcoords' attribute bindings
+		if (hasTC)
 		{
-			GLuint location = glGetAttribLocation(program, "vs_texcoord");
-			glVertexAttribBinding(location, location);
-			glBindVertexBuffer(location, vbo_texcoords, 0, sizeof(GLfloat)* 2);
-			glVertexAttribFormat(location, 2, GL_FLOAT, GL_FALSE, 0);
+			GLuint location = XRShaderUtils::attribLocation(program, "vs_texcoord");
+			glBindBuffer(GL_ARRAY_BUFFER, vbo_texcoords);
+			glVertexAttribPointer(location, 2, GL_FLOAT, GL_FALSE, sizeof(GLfloat)* 2, 0);
 			glEnableVertexAttribArray(location);
 		}
 
 		//set up normals' attribute bindings
 		{
-			GLuint location = glGetAttribLocation(program, "vs_norm");
-			glVertexAttribBinding(location, location);
-			glBindVertexBuffer(location, vbo_normals, 0, sizeof(GLfloat)* 3);
-			glVertexAttribFormat(location, 3, GL_FLOAT, GL_FALSE, 0);
+			GLuint location = XRShaderUtils::attribLocation(program, "vs_norm");
+			glBindBuffer(GL_ARRAY_BUFFER, normal_buffer);
+			glVertexAttribPointer(location, 3, GL_FLOAT, GL_FALSE, sizeof(GLfloat)* 3, 0);
 			glEnableVertexAttribArray(location);
 		}
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+		//the element buffer binding is part of the vao state
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
 
         //unbind vao
         glBindVertexArray(0);
     }
     
     /**
-     * Load Texture
+     * Load Texture, from the image decoded by the loader
      */
     void loadTexture()
     {
-        /* load an image file directly as a new OpenGL texture */
-        texture = SOIL_load_OGL_texture(
-         textureFileName,
-         SOIL_LOAD_AUTO,
-         SOIL_CREATE_NEW_ID,
-         SOIL_FLAG_MIPMAPS | SOIL_FLAG_INVERT_Y | SOIL_FLAG_NTSC_SAFE_RGB | SOIL_FLAG_COMPRESS_TO_DXT);
+        /*
+         * create a new OpenGL texture from the decoded image, as
+         * SOIL_create_OGL_texture with SOIL_FLAG_MIPMAPS | SOIL_FLAG_INVERT_Y |
+         * SOIL_FLAG_NTSC_SAFE_RGB did, which reads the extension string a core
+         * context no longer has
+         */
+        if (textureImage != NULL)
+        {
+            static const GLenum formats[5] = { 0, GL_RED, GL_RG, GL_RGB, GL_RGBA };
+            size_t row = (size_t)textureWidth * textureChannels;
+            for (int y = 0; y < textureHeight / 2; y++)
+                std::swap_ranges(textureImage + row * y, textureImage + row * (y + 1), textureImage + row * (textureHeight - 1 - y));
+            int colors = textureChannels == 2 || textureChannels == 4 ? textureChannels - 1 : textureChannels;
+            for (size_t i = 0; i < row * textureHeight; i++)
+            {
+                if ((int)(i % textureChannels) < colors) textureImage[i] = (unsigned char)(16 + textureImage[i] * 219 / 255);
+            }
+
+            glGenTextures(1, &texture);
+            glBindTexture(GL_TEXTURE_2D, texture);
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+            glTexImage2D(GL_TEXTURE_2D, 0, formats[textureChannels], textureWidth, textureHeight, 0,
+                formats[textureChannels], GL_UNSIGNED_BYTE, textureImage);
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+            if (textureChannels <= 2)
+            {
+                //luminance and luminance alpha
+                GLint swizzle[4] = { GL_RED, GL_RED, GL_RED, textureChannels == 2 ? GL_GREEN : GL_ONE };
+                glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+            }
+            glGenerateMipmap(GL_TEXTURE_2D);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            SOIL_free_image_data(textureImage);
+            textureImage = NULL;
+        }
         
         if(texture == 0)
         {
@@ -399,107 +1080,630 @@ namespace Application
     }
     
     /**
-     * Load blendshapes obj from files, compute the differneces with neutral expression,
-     * and stack the data into a texture buffer.
+     * Create the storage buffer of the deltas, zero for every target until
+     * it is loaded and its sparse form is uploaded, with its buffer texture
+     * on a 3.3 context, and the uniform buffer of the weights, see
+     * uploadWeights.
      */
     void initBlendShapes()
     {
-        //Read positions data from blendshape files
-        std::vector<std::vector<float>> blendshape_positions(NUM_BLENDSHAPE);
-		std::vector<std::vector<float>> blendshape_normals(NUM_BLENDSHAPE);
-        for(int i=0; i<NUM_BLENDSHAPE; i++)
-        {
-            const char* ObjFileName = blendShapesFileNames[i];
-            
-            std::cout << "-- Reading " << ObjFileName << std::endl;
-            
-            std::vector<tinyobj::shape_t> shapes;
-            std::vector<tinyobj::material_t> materials;
-            
-            //load obj file
-            std::string err;
-            bool ret = tinyobj::LoadObj(shapes, materials, err, ObjFileName);
-            
-            if (!err.empty()) { // `err` may contain warning message.
-                std::cerr << err << std::endl;
-            }
-            
-            if (!ret) {
-                exit(1);
-            }
-            
-            //initialize positions vector array
-            blendshape_positions[i].reserve(size_positions);
-			blendshape_normals[i].reserve(size_normals);
-            
-            
-            //fill the positions array
-            for (size_t j = 0; j < shapes.size(); j++) {
-                
-                //make sure the data is good
-                assert((shapes[j].mesh.indices.size()   % 3) == 0);
-                assert((shapes[j].mesh.positions.size() % 3) == 0);
-                assert((shapes[j].mesh.texcoords.size() % 2) == 0);
-                
-                //for all the triangles
-                for (size_t f = 0; f < shapes[j].mesh.indices.size() / 3; f++) {
-                    
-                    //for all the 3 vertices
-                    for (int viter = 0; viter < 3; viter ++)
-                    {
-                        int vidx = shapes[j].mesh.indices[3*f+viter];
-                        blendshape_positions[i].push_back(shapes[j].mesh.positions[vidx*3 + 0]);
-                        blendshape_positions[i].push_back(shapes[j].mesh.positions[vidx*3 + 1]);
-                        blendshape_positions[i].push_back(shapes[j].mesh.positions[vidx*3 + 2]);
-						blendshape_normals[i].push_back(shapes[j].mesh.normals[vidx * 3 + 0]);
-						blendshape_normals[i].push_back(shapes[j].mesh.normals[vidx * 3 + 1]);
-						blendshape_normals[i].push_back(shapes[j].mesh.normals[vidx * 3 + 2]);
-                    }
-                }
-            }
-        }
-        
-		//compute the difference vector
-		for (int j = 0; j< size_positions; j++)
+		glGenBuffers(1, &ssbo_deltas);
+		if (!computeShaders)
+		{
+			//the texture follows the buffer through every glBufferData
+			glBindBuffer(GL_TEXTURE_BUFFER, ssbo_deltas);
+			glGenTextures(1, &tbo_deltas);
+			glBindTexture(GL_TEXTURE_BUFFER, tbo_deltas);
+			glTexBuffer(GL_TEXTURE_BUFFER, GL_R32UI, ssbo_deltas);
+			glBindTexture(GL_TEXTURE_BUFFER, 0);
+			glBindBuffer(GL_TEXTURE_BUFFER, 0);
+		}
+		glGenBuffers(1, &ubo_weights);
+		glBindBuffer(GL_UNIFORM_BUFFER, ubo_weights);
+		glBufferData(GL_UNIFORM_BUFFER, sizeof(glm::vec4) * 2 + sizeof(ActiveTarget) * maxActiveTargets, NULL, GL_DYNAMIC_DRAW);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+		buildSparseTargets();
+		uploadBlendShapes();
+	}
+
+    /**
+     * Rebuild the sparse form of the loaded targets from the dense deltas of
+     * the rig with the current deltaEpsilon.
+     */
+    void buildSparseTargets()
+    {
+		for (int i = 0; i < NUM_BLENDSHAPE; i++)
+		{
+			if (targetLoaded[i]) buildSparseTarget(i);
+		}
+	}
+
+    /* build the sparse form of one target and update the report of how much was dropped */
+    void buildSparseTarget(int i)
+    {
+		BlendShapes::makeSparse(targetPositions[i], targetNormals[i], rig.num_vertices, deltaEpsilon, sparseTargets[i]);
+		if (blendRig.data != NULL)
 		{
-			for (int i = 0; i<NUM_BLENDSHAPE; i++)
+			std::vector<float> bs_positions(size_positions), bs_normals(size_normals);
+			BlendShapes::expand(sparseTargets[i], rig.num_vertices, &bs_positions[0], &bs_normals[0]);
+			BlendEngine::setTarget(blendRig, i, &bs_positions[0], &bs_normals[0]);
+			BlendEngine::invalidate(blended);
+		}
+
+		size_t kept = 0;
+		int loaded = 0;
+		sparseMaxError = sparseMaxNormalError = 0.0f;
+		for (int j = 0; j < NUM_BLENDSHAPE; j++)
+		{
+			if (!targetLoaded[j]) continue;
+			loaded++;
+			kept += sparseTargets[j].vertices.size();
+			sparseMaxError = std::max(sparseMaxError, sparseTargets[j].max_position_error);
+			sparseMaxNormalError = std::max(sparseMaxNormalError, sparseTargets[j].max_normal_error);
+		}
+		sparseKept = loaded > 0 ? (float)kept / ((float)rig.num_vertices * loaded) : 1.0f;
+	}
+
+    /* bytes of one delta component and of the deltas of a vertex in ssbo_deltas, see blendShapes.glsl */
+    static int deltaComponentSize(int format)
+    {
+		return format == DELTAS_FLOAT ? 4 : format == DELTAS_BYTE ? 1 : 2;
+	}
+
+    static int deltaVertexSize(int format, bool normals)
+    {
+		//padded to whole words
+		return ((normals ? 6 : 3) * deltaComponentSize(format) + 3) & ~3;
+	}
+
+    /* the shaders read the normal deltas unless the normals are recomputed from the blended positions */
+    bool deltaNormals()
+    {
+		return blendMode == BLEND_VERTEX || blendMode == BLEND_FEEDBACK || normalMode == NORMALS_BLENDED;
+	}
+
+    /* pack the deltas again when the normal deltas are needed or no longer are, after a mode change */
+    void updateDeltaNormals()
+    {
+		if (neutralLoaded && uploadedNormals != deltaNormals()) uploadBlendShapes();
+	}
+
+    /**
+     * Pack every target into a new ssbo_deltas in deltaFormat, one after the
+     * other. A target that is not loaded yet keeps room for its dense
+     * deltas, so loading it does not move the others. When the deltas do
+     * not fit a shader storage block the next smaller format is tried; if
+     * not even 8 bit deltas fit, nothing is uploaded and only the CPU blends
+     * until a larger epsilon or the positions alone make them fit.
+     */
+    void uploadBlendShapes()
+    {
+		GLint64 max_size = 0;
+		if (computeShaders)
+		{
+			glGetInteger64v(GL_MAX_SHADER_STORAGE_BLOCK_SIZE, &max_size);
+		}
+		else
+		{
+			glGetInteger64v(GL_MAX_TEXTURE_BUFFER_SIZE, &max_size);
+			max_size *= 4;
+		}
+		std::vector<GLuint> packed[NUM_BLENDSHAPE];
+		GLint64 words = 0;
+		for (;;)
+		{
+			words = 0;
+			for (int i = 0; i < NUM_BLENDSHAPE; i++)
 			{
-				blendshape_positions[i][j] -= positions[j];
-				blendshape_normals[i][j] -= normals[j];
+				deltaCounts[i] = packBlendShape(i, packed[i]);
+				deltaOffsets[i] = (GLuint)words;
+				deltaCapacities[i] = targetLoaded[i] ? packed[i].size()
+					: (size_t)deltaVertexSize(deltaFormat, deltaNormals()) / 4 * rig.num_vertices;
+				words += deltaCapacities[i];
 			}
+			if (words * 4 <= max_size || deltaFormat == DELTAS_BYTE) break;
+			std::cerr << "The deltas take " << words * 4 << " bytes, more than the " << max_size
+				<< " the shaders can read here, trying a smaller delta format" << std::endl;
+			deltaFormat++;
 		}
 
-		//set up vertex buffer objects
-		glBindVertexArray(vao);
-		glGenBuffers(NUM_BLENDSHAPE, vbo_bs_positions);
-		glGenBuffers(NUM_BLENDSHAPE, vbo_bs_normals);
+		uploadedFormat = deltaFormat;
+		uploadedNormals = deltaNormals();
+		gpuDeltas = words * 4 <= max_size;
+		if (!gpuDeltas)
+		{
+			std::cerr << "The deltas take " << words * 4 << " bytes even with 8 bits, only the CPU blends" << std::endl;
+			//uploadedNormals is set, the normal deltas are packed again at most once if the mode drops them
+			if (blendMode != BLEND_CPU) setBlendMode(BLEND_CPU);
+			return;
+		}
+		deltaBytes = words * 4;
+		glBindBuffer(GL_COPY_WRITE_BUFFER, ssbo_deltas);
+		glBufferData(GL_COPY_WRITE_BUFFER, (GLsizeiptr)deltaBytes, NULL, GL_STATIC_DRAW);
+		for (int i = 0; i < NUM_BLENDSHAPE; i++)
+		{
+			glBufferSubData(GL_COPY_WRITE_BUFFER, (GLintptr)deltaOffsets[i] * 4, packed[i].size() * 4, &packed[i][0]);
+		}
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		cacheDirty = true;
+	}
+
+    /**
+     * Store a target in its place in ssbo_deltas, or pack them all again
+     * when it no longer fits there.
+     */
+    void uploadBlendShape(int i)
+    {
+		std::vector<GLuint> packed;
+		GLuint count = packBlendShape(i, packed);
+		if (!gpuDeltas || uploadedFormat != deltaFormat || uploadedNormals != deltaNormals() || packed.size() > deltaCapacities[i])
+		{
+			uploadBlendShapes();
+			return;
+		}
+		deltaCounts[i] = count;
+		glBindBuffer(GL_COPY_WRITE_BUFFER, ssbo_deltas);
+		glBufferSubData(GL_COPY_WRITE_BUFFER, (GLintptr)deltaOffsets[i] * 4, packed.size() * 4, &packed[0]);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		cacheDirty = true;
+	}
+
+    /**
+     * Expand the sparse form of a target and encode it in deltaFormat, the
+     * position and normal deltas of each vertex side by side, or the
+     * position deltas alone when the normals are recomputed. Half deltas
+     * are unpacked to floats by the shaders, quantized ones are read as
+     * normalized integers and scaled back by the weights, see uploadWeights;
+     * the shaders accumulate in floats either way. Only the vertices of the
+     * sparse form are kept, after their sorted indices and followed by the
+     * encoded zero of the vertices left out, unless the deltas of every
+     * vertex take less room. A target that is not loaded yet has no sparse
+     * deltas and is all zero. Returns the vertices listed, rig.num_vertices
+     * for a dense target, see findDeltas in blendShapes.glsl.
+     */
+    GLuint packBlendShape(int i, std::vector<GLuint>& words)
+    {
+		std::vector<GLfloat> bs_positions(size_positions);
+		std::vector<GLfloat> bs_normals(size_normals);
+		std::vector<SimdKernels::half> half_positions, half_normals;
+
+		BlendShapes::expand(sparseTargets[i], rig.num_vertices, &bs_positions[0], &bs_normals[0]);
+		const void* data_positions = &bs_positions[0];
+		const void* data_normals = &bs_normals[0];
+		deltaErrors[i] = 0.0f;
+		if (deltaFormat == DELTAS_HALF)
+		{
+			const SimdKernels::Table& kernels = SimdKernels::get();
+			half_positions.resize(size_positions);
+			half_normals.resize(size_normals);
+			kernels.toHalf(&bs_positions[0], size_positions, &half_positions[0]);
+			kernels.toHalf(&bs_normals[0], size_normals, &half_normals[0]);
+			data_positions = &half_positions[0];
+			data_normals = &half_normals[0];
+			for (int j = 0; j < size_positions; j++)
+				deltaErrors[i] = std::max(deltaErrors[i], std::fabs(SimdKernels::halfToFloat(half_positions[j]) - bs_positions[j]));
+		}
+		else if (deltaFormat != DELTAS_FLOAT)
+		{
+			BlendShapes::quantize(&bs_positions[0], &bs_normals[0], rig.num_vertices, deltaFormat == DELTAS_BYTE ? 8 : 16,
+				quantizedTargets[i]);
+			data_positions = &quantizedTargets[i].positions[0];
+			data_normals = &quantizedTargets[i].normals[0];
+			deltaErrors[i] = quantizedTargets[i].max_position_error;
+		}
+		quantizedMaxError = *std::max_element(deltaErrors, deltaErrors + NUM_BLENDSHAPE);
+
+		//the position and the normal deltas of the vertices kept
+		bool normals = deltaNormals();
+		int component = deltaComponentSize(deltaFormat);
+		int vertex = deltaVertexSize(deltaFormat, normals);
+		const std::vector<unsigned int>& listed = sparseTargets[i].vertices;
+		GLuint count = (GLuint)listed.size();
+		size_t sparse_words = count + (size_t)(count + 1) * vertex / 4;
+		size_t dense_words = (size_t)rig.num_vertices * vertex / 4;
+		bool dense = sparse_words >= dense_words;
+		words.assign(dense ? dense_words : sparse_words, 0);
+		GLuint left_out = 0;    //a vertex without deltas, whose encoded zero ends a sparse target
+		if (dense) count = rig.num_vertices;
+		else
+		{
+			std::copy(listed.begin(), listed.end(), words.begin());
+			while (left_out < count && listed[left_out] == left_out) left_out++;
+		}
+
+		char* rows = (char*)&words[dense ? 0 : count];
+		GLuint num_rows = dense ? count : count + 1;
+		for (GLuint r = 0; r < num_rows; r++)
+		{
+			GLuint v = dense ? r : r < count ? listed[r] : left_out;
+			memcpy(rows + (size_t)vertex * r, (const char*)data_positions + (size_t)component * 3 * v, component * 3);
+			if (normals)
+				memcpy(rows + (size_t)vertex * r + component * 3, (const char*)data_normals + (size_t)component * 3 * v, component * 3);
+		}
+		return count;
+	}
+
+    /**
+     * Fill the Weights block of blendShapes.glsl with the targets whose
+     * weight is not zero, the decoding of quantized deltas folded in: every
+     * one gets its weight times its decoding scale, and the weighted sum of
+     * their decoding offsets is added once as a bias. The shaders fetch the
+     * deltas of these targets only. Returns their number, for numActive.
+     */
+    int uploadWeights()
+    {
+		struct
+		{
+			glm::vec4 bias[2];      //positions, normals
+			ActiveTarget active[NUM_BLENDSHAPE];
+		} block;
+		block.bias[0] = block.bias[1] = glm::vec4(0.0f);
+		int n = 0;
 		for (int i = 0; i < NUM_BLENDSHAPE; i++)
 		{
+			if (weights[i] == 0.0f) continue;
+			ActiveTarget& a = block.active[n++];
+			a.offset = deltaOffsets[i];
+			a.count = deltaCounts[i];
+			a.position_weight = a.normal_weight = glm::vec3(weights[i]);
+			if (uploadedFormat == DELTAS_FLOAT || uploadedFormat == DELTAS_HALF) continue;
+			const BlendShapes::QuantizedTarget& q = quantizedTargets[i];
+			a.position_weight *= glm::make_vec3(q.position_scale);
+			a.normal_weight   *= glm::make_vec3(q.normal_scale);
+			block.bias[0] += weights[i] * glm::vec4(glm::make_vec3(q.position_offset), 0.0f);
+			if (uploadedNormals) block.bias[1] += weights[i] * glm::vec4(glm::make_vec3(q.normal_offset), 0.0f);
+		}
+		glBindBuffer(GL_UNIFORM_BUFFER, ubo_weights);
+		glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(block.bias) + sizeof(ActiveTarget) * n, &block);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+		gpuActiveTargets = n;
+		return n;
+	}
+
+    /**
+     * Switch between blending in the vertex shader, on the CPU, in the
+     * compute shader and with transform feedback. The CPU and the compute
+     * shader blend into the neutral vertex buffers, which are restored when
+     * switching to a mode that reads them.
+     */
+    void setBlendMode(int mode)
+    {
+		blendMode = mode;
+		cacheDirty = true;
+		BlendEngine::invalidate(blended);
+		if (mode == BLEND_COMPUTE && normalMode == NORMALS_CPU) normalMode = NORMALS_BLENDED;
+		updateDeltaNormals();
+		if (mode == BLEND_CPU)
+		{
+			if (blended.mesh != NULL) return;
+			if (blendRig.data == NULL) createBlendRig();
+			BlendEngine::create(blendRig, blended);
+			BlendSelector::calibrate(blendRig, positions, normals, blendCosts);
+			std::cout << "CPU blend (" << CpuFeatures::name(SimdKernels::get().level) << "): dense";
+			for (size_t i = 0; i < blendCosts.dense_targets.size(); i++)
+				std::cout << (i ? ", " : " ") << blendCosts.dense_times[i] << " ms with " << blendCosts.dense_targets[i];
+			std::cout << " targets, sparse " << blendCosts.sparse_base << " ms + "
+				<< blendCosts.sparse_per_delta * 1e6 << " ns per delta" << std::endl;
+			return;
+		}
+
+		if (mode == BLEND_COMPUTE) return;
+		glBindBuffer(GL_ARRAY_BUFFER, vbo_positions);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(GLfloat) * size_positions, positions);
+		glBindBuffer(GL_ARRAY_BUFFER, vbo_normals);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(GLfloat) * size_normals, normals);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+    /* expand the sparse targets loaded so far into blendRig */
+    void createBlendRig()
+    {
+		BlendEngine::create(blendRig, positions, normals, rig.num_vertices, NUM_BLENDSHAPE);
+		BlendEngine::setHalfPrecision(blendRig, halfPrecision);
+		for (int i = 0; i < NUM_BLENDSHAPE; i++)
+		{
+			if (targetLoaded[i]) buildSparseTarget(i);
+		}
+	}
+
+    /**
+     * Blend the current weights with BlendEngine and upload the result as the
+     * mesh to draw. In incremental mode nothing is done while the weights
+     * stay the same, otherwise the dense or the sparse kernel blends every
+     * frame from scratch. Half precision and the low rank basis only exist
+     * for the dense kernel.
+     */
+    void blendOnCPU()
+    {
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		std::vector<GLfloat> blended_positions(size_positions), blended_normals(size_normals);
+
+		//the low rank basis is blended like targets, with weights derived from the target weights
+		const BlendEngine::Rig* engine = &blendRig;
+		const float* engine_weights = weights;
+		float basis_weights[NUM_BLENDSHAPE];
+		//another tolerance needs another slice of the components, the current one is blended until it arrives
+		if (lowRank && !factoring && (lowRankDirty ||
+			(basisRig.data != NULL && std::max(lowRankBasis.rank, 1) != basisRig.num_targets))) startFactorize();
+		bool useBasis = lowRank && basisRig.data != NULL;   //the targets are blended until the first basis arrives
+		if (useBasis)
+		{
+			BlendShapes::basisWeights(lowRankBasis, weights, basis_weights);
+			engine = &basisRig;
+			engine_weights = basis_weights;
+			if (blendRig.data != NULL) BlendEngine::destroy(blendRig);
+		}
+		else if (blendRig.data == NULL)
+		{
+			createBlendRig();
+		}
+
+		if (incrementalBlend)
+		{
+			cpuBlendTargets = BlendEngine::update(*engine, engine_weights, blended);
+			if (cpuBlendTargets == 0) return;
+			BlendEngine::interleave(*engine, blended.mesh, &blended_positions[0], &blended_normals[0]);
+		}
+		else
+		{
+			if (autoKernel) blendKernel = BlendSelector::choose(blendCosts, sparseTargets, weights, NUM_BLENDSHAPE);
+			cpuBlendTargets = useBasis ? std::min(lowRankBasis.rank, basisRig.num_targets)
+				: (int)(NUM_BLENDSHAPE - std::count(weights, weights + NUM_BLENDSHAPE, 0.0f));
+			if (blendKernel == BlendSelector::SPARSE && !useBasis && !halfPrecision)
 			{
-				glBindBuffer(GL_ARRAY_BUFFER, vbo_bs_positions[i]);
-				glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat)* blendshape_positions[i].size(), &blendshape_positions[i][0], GL_STATIC_DRAW);
-				char attriName[10];
-				sprintf(attriName, "pos%d", i);
-				GLuint location = glGetAttribLocation(program, attriName);
-				glVertexAttribBinding(location, location);
-				glBindVertexBuffer(location, vbo_bs_positions[i], 0, sizeof(GLfloat)* 3);
-				glVertexAttribFormat(location, 3, GL_FLOAT, GL_FALSE, 0);
-				glEnableVertexAttribArray(location);
+				BlendShapes::evaluate(positions, normals, rig.num_vertices, sparseTargets, weights, NUM_BLENDSHAPE,
+					&blended_positions[0], &blended_normals[0]);
 			}
+			else
 			{
-				glBindBuffer(GL_ARRAY_BUFFER, vbo_bs_normals[i]);
-				glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat)* blendshape_normals[i].size(), &blendshape_normals[i][0], GL_STATIC_DRAW);
-				char attriName[10];
-				sprintf(attriName, "norm%d", i);
-				GLuint location = glGetAttribLocation(program, attriName);
-				glVertexAttribBinding(location, location);
-				glBindVertexBuffer(location, vbo_bs_normals[i], 0, sizeof(GLfloat)* 3);
-				glVertexAttribFormat(location, 3, GL_FLOAT, GL_FALSE, 0);
-				glEnableVertexAttribArray(location);
+				BlendEngine::evaluateParallel(*engine, engine_weights, blended.mesh);
+				BlendEngine::interleave(*engine, blended.mesh, &blended_positions[0], &blended_normals[0]);
 			}
+			BlendEngine::invalidate(blended);
+		}
+		cpuBlendTime = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+		//blend again from the float deltas, outside of the timing
+		if (halfPrecision && validateHalf)
+			BlendEngine::halfError(*engine, engine_weights, halfPositionError, halfNormalError);
+
+		start = std::chrono::steady_clock::now();
+		if (normalMode == NORMALS_CPU)
+		{
+			MeshNormals::compute(adjacency, rig.indices, num_indices, &blended_positions[0], rig.num_vertices,
+				&blended_normals[0], faceNormals);
+		}
+		glBindBuffer(GL_ARRAY_BUFFER, vbo_positions);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(GLfloat) * size_positions, &blended_positions[0]);
+		if (normalMode != NORMALS_GPU)
+		{
+			glBindBuffer(GL_ARRAY_BUFFER, vbo_normals);
+			glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(GLfloat) * size_normals, &blended_normals[0]);
 		}
 		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		if (normalMode == NORMALS_GPU) recomputeNormalsOnGPU();
+		normalTime = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+    /**
+     * Factor the loaded targets into their principal components on the
+     * loader, with the error of every rank, and make the components of the
+     * rank for lowRankTolerance the targets of factoredRig. processLoadQueue
+     * swaps both in. Only that slice is kept: when the tolerance asks for
+     * another rank the components are rebuilt from the targets with the
+     * coefficients of lowRankBasis, without factoring again.
+     */
+    void startFactorize()
+    {
+		factoring = true;
+		bool refactor = lowRankDirty;
+		float tolerance = lowRankTolerance;
+		lowRankDirty = false;
+		if (!refactor) factoredBasis = lowRankBasis;
+		std::vector<const float*> bs_positions(NUM_BLENDSHAPE, NULL), bs_normals(NUM_BLENDSHAPE, NULL);
+		for (int i = 0; i < NUM_BLENDSHAPE; i++)
+		{
+			if (!targetLoaded[i]) continue;
+			bs_positions[i] = targetPositions[i];
+			bs_normals[i] = targetNormals[i];
+		}
+		loader.run([bs_positions, bs_normals, refactor, tolerance]() mutable {
+			std::vector<float> zero(size_positions, 0.0f);
+			for (int i = 0; i < NUM_BLENDSHAPE; i++)
+			{
+				if (bs_positions[i] == NULL) bs_positions[i] = bs_normals[i] = &zero[0];
+			}
+			if (refactor) BlendShapes::factorize(&bs_positions[0], &bs_normals[0], rig.num_vertices, NUM_BLENDSHAPE, factoredBasis);
+			std::vector<float>().swap(factoredBasis.positions);
+			std::vector<float>().swap(factoredBasis.normals);
+
+			//one component at rank 0, with a zero weight, so the blend still writes the neutral mesh
+			BlendShapes::setRankForError(factoredBasis, tolerance);
+			int components = std::max(factoredBasis.rank, 1);
+			BlendEngine::create(factoredRig, positions, normals, rig.num_vertices, components);
+			std::vector<float> basis_positions(size_positions), basis_normals(size_normals);
+			for (int i = 0; i < components; i++)
+			{
+				BlendShapes::basisMesh(factoredBasis, &bs_positions[0], &bs_normals[0], rig.num_vertices, i,
+					&basis_positions[0], &basis_normals[0]);
+				BlendEngine::setTarget(factoredRig, i, &basis_positions[0], &basis_normals[0]);
+			}
+			postLoad(LOAD_FACTORED, -1);
+		});
+	}
+
+    /* the compute shaders of the GPU normals and the adjacency they read */
+    void initNormalShaders()
+    {
+		GLuint shader = XRShaderUtils::loadShader(faceNormalsShaderName, GL_COMPUTE_SHADER, true);
+		XRShaderUtils::reflectProgram(XRShaderUtils::linkShaderProgram(&shader, 1, true), faceNormalsProgram);
+		shader = XRShaderUtils::loadShader(vertexNormalsShaderName, GL_COMPUTE_SHADER, true);
+		XRShaderUtils::reflectProgram(XRShaderUtils::linkShaderProgram(&shader, 1, true), vertexNormalsProgram);
+		numTrianglesLocation = XRShaderUtils::uniformLocation(faceNormalsProgram, "numTriangles");
+		numNormalsLocation = XRShaderUtils::uniformLocation(vertexNormalsProgram, "numVertices");
+
+		glGenBuffers(1, &ssbo_faceNormals);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo_faceNormals);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLfloat) * num_indices, NULL, GL_DYNAMIC_COPY);
+
+		const std::vector<int>* arrays[3] = { &adjacency.welded, &adjacency.offsets, &adjacency.triangles };
+		glGenBuffers(3, ssbo_adjacency);
+		for (int i = 0; i < 3; i++)
+		{
+			glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo_adjacency[i]);
+			glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLint) * arrays[i]->size(), &(*arrays[i])[0], GL_STATIC_DRAW);
+		}
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	}
+
+    /**
+     * Recompute vbo_normals from vbo_positions: one pass writes the normal of
+     * every triangle, a second one sums them around every vertex.
+     */
+    void recomputeNormalsOnGPU()
+    {
+		if (faceNormalsProgram.id == 0) initNormalShaders();
+		const GLuint group_size = 64;
+		GLuint num_triangles = (GLuint)num_indices / 3;
+		GLuint num_vertices = (GLuint)rig.num_vertices;
+
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, vbo_positions);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, ebo);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, ssbo_faceNormals);
+		for (int i = 0; i < 3; i++) glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3 + i, ssbo_adjacency[i]);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, vbo_normals);
+
+		glUseProgram(faceNormalsProgram.id);
+		glUniform1ui(numTrianglesLocation, num_triangles);
+		glDispatchCompute((num_triangles + group_size - 1) / group_size, 1, 1);
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+		glUseProgram(vertexNormalsProgram.id);
+		glUniform1ui(numNormalsLocation, num_vertices);
+		glDispatchCompute((num_vertices + group_size - 1) / group_size, 1, 1);
+		glMemoryBarrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+		glUseProgram(0);
+	}
+
+    /* the blend compute shader and the neutral mesh it reads, vbo_positions and vbo_normals being its output */
+    void initBlendShader()
+    {
+		const char* sources[3] = { deltasBufferShaderName, blendShapesShaderName, blendShaderName };
+		GLuint shader = XRShaderUtils::loadShader(sources, 3, GL_COMPUTE_SHADER, true);
+		XRShaderUtils::reflectProgram(XRShaderUtils::linkShaderProgram(&shader, 1, true), blendProgram);
+		blendProgramLocations = locateBlend(blendProgram);
+		bindBlocks(blendProgram.id);
+
+		const GLfloat* arrays[2] = { positions, normals };
+		glGenBuffers(2, ssbo_neutral);
+		for (int i = 0; i < 2; i++)
+		{
+			glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo_neutral[i]);
+			glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLfloat) * size_positions, arrays[i], GL_STATIC_DRAW);
+		}
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	}
+
+    /**
+     * Blend every vertex once in a compute shader into vbo_positions and
+     * vbo_normals, which every pass then draws with no blending left in its
+     * vertex shader. Nothing is done while the weights and the deltas stay
+     * the same.
+     */
+    void blendOnGPU()
+    {
+		if (cacheValid()) return;
+		if (blendProgram.id == 0) initBlendShader();
+		const GLuint group_size = 64;
+		GLuint num_vertices = (GLuint)rig.num_vertices;
+
+		int numActive = uploadWeights();
+		glBindBufferBase(GL_UNIFORM_BUFFER, weightsBinding, ubo_weights);
+		bindDeltas();
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, vbo_positions);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, ssbo_neutral[0]);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, ssbo_neutral[1]);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, vbo_normals);
+
+		glUseProgram(blendProgram.id);
+		setBlendUniforms(blendProgramLocations, numActive);
+		glDispatchCompute((num_vertices + group_size - 1) / group_size, 1, 1);
+		glUseProgram(0);
+
+		//the normal passes read the blended positions as a storage buffer, the draws as vertices
+		if (normalMode == NORMALS_GPU)
+		{
+			glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+			recomputeNormalsOnGPU();
+		}
+		else glMemoryBarrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+
+		std::copy(weights, weights + NUM_BLENDSHAPE, cachedWeights);
+		cacheDirty = false;
+		cacheUpdates++;
+	}
+
+    /* whether the last compute or feedback blend still holds */
+    bool cacheValid()
+    {
+		return !cacheDirty && std::equal(weights, weights + NUM_BLENDSHAPE, cachedWeights);
+	}
+
+    /* the feedback program and the buffers and the vertex array of its capture */
+    void initFeedback()
+    {
+		const char* sources[3] = { computeShaders ? deltasBufferShaderName : deltasTextureShaderName,
+			blendShapesShaderName, vertexShaderName };
+		const char* varyings[2] = { "m_position", "m_normal" };
+		GLuint shader = XRShaderUtils::loadShader(sources, 3, GL_VERTEX_SHADER, true);
+		XRShaderUtils::reflectProgram(XRShaderUtils::linkShaderProgram(&shader, 1, true, varyings, 2, true), feedbackProgram);
+		feedbackLocations = locateBlend(feedbackProgram);
+		bindBlocks(feedbackProgram.id);
+
+		glGenBuffers(2, vbo_feedback);
+		for (int i = 0; i < 2; i++)
+		{
+			glBindBuffer(GL_ARRAY_BUFFER, vbo_feedback[i]);
+			glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * size_positions, NULL, GL_DYNAMIC_COPY);
+		}
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		initVAO(vao_feedback, vbo_feedback[0], vbo_feedback[1]);
+	}
+
+    /**
+     * Run the blend of the vertex shader once over the neutral vertices,
+     * with no rasterization, and capture the blended positions and normals
+     * into vbo_feedback, which render then draws with no blending. Like the
+     * compute blend nothing is done while the weights and the deltas stay
+     * the same, but it needs no compute shader: on a 3.3 context it reads
+     * the deltas through tbo_deltas.
+     */
+    void blendWithFeedback()
+    {
+		if (cacheValid()) return;
+		if (feedbackProgram.id == 0) initFeedback();
+
+		int numActive = uploadWeights();
+		glBindBufferBase(GL_UNIFORM_BUFFER, weightsBinding, ubo_weights);
+		bindDeltas();
+		glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, vbo_feedback[0]);
+		glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 1, vbo_feedback[1]);
+
+		glUseProgram(feedbackProgram.id);
+		setBlendUniforms(feedbackLocations, numActive);
+		glBindVertexArray(vao);
+		glEnable(GL_RASTERIZER_DISCARD);
+		glBeginTransformFeedback(GL_POINTS);
+		glDrawArrays(GL_POINTS, 0, rig.num_vertices);
+		glEndTransformFeedback();
+		glDisable(GL_RASTERIZER_DISCARD);
 		glBindVertexArray(0);
+		glUseProgram(0);
+
+		std::copy(weights, weights + NUM_BLENDSHAPE, cachedWeights);
+		cacheDirty = false;
+		cacheUpdates++;
 	}
 #pragma endregion
 
@@ -575,13 +1779,114 @@ namespace Application
 		ImGui_ImplGlfwGL3_NewFrame();
 		{
 			static float f = 0.0f;
+			if (loadProgress < NUM_BLENDSHAPE + 2)
+			{
+				char overlay[32];
+				sprintf(overlay, "Loading %d/%d", loadProgress, NUM_BLENDSHAPE + 2);
+				ImGui::ProgressBar((float)loadProgress / (NUM_BLENDSHAPE + 2), ImVec2(-1, 0), overlay);
+			}
+
 			ImGui::Text("Facial Blending Shapes");
-			ImGui::SliderFloat("Angry", &weights[0], 0.0f, 1.0f);
-			ImGui::SliderFloat("Cry", &weights[1], 0.0f, 1.0f);
-			ImGui::SliderFloat("Fury", &weights[2], 0.0f, 1.0f);
-			ImGui::SliderFloat("Grin", &weights[3], 0.0f, 1.0f);
-			ImGui::SliderFloat("Laugh", &weights[4], 0.0f, 1.0f);
-			ImGui::SliderFloat("Rage", &weights[5], 0.0f, 1.0f);
+			static const char* names[NUM_BLENDSHAPE] = { "Angry", "Cry", "Fury", "Grin", "Laugh", "Rage", "Sad", "Smile", "Surprise" };
+			for (int i = 0; i < NUM_BLENDSHAPE; i++)
+			{
+				if (targetLoaded[i]) ImGui::SliderFloat(names[i], &weights[i], 0.0f, 1.0f);
+				else ImGui::TextDisabled("%s (loading)", names[i]);
+			}
+
+			ImGui::Text("Delta Storage");
+			if (!neutralLoaded)
+			{
+				ImGui::TextDisabled("(loading)");
+			}
+			else if (ImGui::SliderFloat("Epsilon", &deltaEpsilon, 0.0f, 0.5f, "%.4f", 3.0f))
+			{
+				buildSparseTargets();
+				uploadBlendShapes();
+			}
+			ImGui::Text("%.1f%% kept, max error %.4f", sparseKept * 100.0f, sparseMaxError);
+			ImGui::Text("%.2f MB on the GPU", deltaBytes / (1024.0 * 1024.0));
+			int format = deltaFormat;
+			ImGui::RadioButton("Float", &deltaFormat, DELTAS_FLOAT); ImGui::SameLine();
+			ImGui::RadioButton("Half", &deltaFormat, DELTAS_HALF); ImGui::SameLine();
+			ImGui::RadioButton("16 bit", &deltaFormat, DELTAS_SHORT); ImGui::SameLine();
+			ImGui::RadioButton("8 bit", &deltaFormat, DELTAS_BYTE);
+			if (deltaFormat != format && neutralLoaded) uploadBlendShapes();
+			if (deltaFormat != DELTAS_FLOAT) ImGui::Text("Quantization error %.4f", quantizedMaxError);
+
+			int mode = blendMode;
+			ImGui::Text("Blend"); ImGui::SameLine();
+			ImGui::RadioButton("Vertex shader", &mode, BLEND_VERTEX); ImGui::SameLine();
+			ImGui::RadioButton("CPU", &mode, BLEND_CPU); ImGui::SameLine();
+			if (computeShaders)
+			{
+				ImGui::RadioButton("Compute", &mode, BLEND_COMPUTE); ImGui::SameLine();
+			}
+			ImGui::RadioButton("Feedback", &mode, BLEND_FEEDBACK);
+			if (mode != blendMode && neutralLoaded && (mode == BLEND_CPU || gpuDeltas)) setBlendMode(mode);
+			if (!gpuDeltas) ImGui::TextDisabled("The deltas do not fit the GPU storage, only the CPU blends");
+			if (blendMode != BLEND_CPU) ImGui::Text("%d active targets", gpuActiveTargets);
+			if (blendMode == BLEND_COMPUTE)
+			{
+				int normals = normalMode;
+				ImGui::Text("%d blends", cacheUpdates); ImGui::SameLine();
+				ImGui::Text("Normals"); ImGui::SameLine();
+				ImGui::RadioButton("Blended", &normalMode, NORMALS_BLENDED); ImGui::SameLine();
+				ImGui::RadioButton("GPU", &normalMode, NORMALS_GPU);
+				if (normalMode != normals)
+				{
+					cacheDirty = true;
+					updateDeltaNormals();
+				}
+			}
+			if (blendMode == BLEND_FEEDBACK) ImGui::Text("%d blends", cacheUpdates);
+			if (blendMode == BLEND_CPU)
+			{
+				ImGui::SameLine(); ImGui::Text("%.3f ms, %d targets, %s", cpuBlendTime, cpuBlendTargets,
+					CpuFeatures::name(SimdKernels::get().level));
+				ImGui::Checkbox("Incremental", &incrementalBlend);
+				int normals = normalMode;
+				ImGui::Text("Normals"); ImGui::SameLine();
+				ImGui::RadioButton("Blended", &normalMode, NORMALS_BLENDED); ImGui::SameLine();
+				ImGui::RadioButton("CPU", &normalMode, NORMALS_CPU);
+				if (computeShaders)
+				{
+					ImGui::SameLine(); ImGui::RadioButton("GPU", &normalMode, NORMALS_GPU);
+				}
+				if (normalMode != normals)
+				{
+					BlendEngine::invalidate(blended);
+					updateDeltaNormals();
+				}
+				if (normalMode != NORMALS_BLENDED) ImGui::Text("Normals %.3f ms", normalTime);
+				if (ImGui::Checkbox("Half precision", &halfPrecision))
+				{
+					if (blendRig.data != NULL) BlendEngine::setHalfPrecision(blendRig, halfPrecision);
+					if (basisRig.data != NULL) BlendEngine::setHalfPrecision(basisRig, halfPrecision);
+					BlendEngine::invalidate(blended);
+				}
+				if (halfPrecision)
+				{
+					ImGui::SameLine(); ImGui::Checkbox("Validate", &validateHalf);
+					if (validateHalf) ImGui::Text("Half error %.5f, normals %.5f", halfPositionError, halfNormalError);
+				}
+				if (ImGui::Checkbox("Low rank", &lowRank)) BlendEngine::invalidate(blended);
+				if (lowRank)
+				{
+					if (ImGui::SliderFloat("Tolerance", &lowRankTolerance, 0.0f, 2.0f, "%.3f", 2.0f))
+						BlendShapes::setRankForError(lowRankBasis, lowRankTolerance);
+					if (basisRig.data == NULL) ImGui::Text("Factoring the targets...");
+					else ImGui::Text("Rank %d of %d, error %.4f%s", lowRankBasis.rank, NUM_BLENDSHAPE, lowRankBasis.max_position_error,
+						std::max(lowRankBasis.rank, 1) != basisRig.num_targets ? " (slicing)" : "");
+				}
+				if (!incrementalBlend && !lowRank && !halfPrecision)
+				{
+					ImGui::Checkbox("Auto kernel", &autoKernel); ImGui::SameLine();
+					if (ImGui::RadioButton("Dense", &blendKernel, BlendSelector::DENSE)) autoKernel = false;
+					ImGui::SameLine();
+					if (ImGui::RadioButton("Sparse", &blendKernel, BlendSelector::SPARSE)) autoKernel = false;
+				}
+			}
 
 			ImGui::Text("Lighting");
 			ImGui::SliderFloat("Ambient", &ambientf, 0.0f, 1.0f);
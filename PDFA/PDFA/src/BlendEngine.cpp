@@ -0,0 +1,358 @@
+//
+//  BlendEngine.cpp
+//  PDFA
+//
+
+#include "BlendEngine.hpp"
+#include "SimdKernels.hpp"
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#ifdef _MSC_VER
+#include <malloc.h>
+#endif
+
+namespace BlendEngine
+{
+	/* floats blended at a time, small enough for the output to stay in L1 across targets */
+	static const int chunkSize = 1024;
+
+	/* floats per parallel task, the output and a chunk of a few dozen targets fit in L2 */
+	static const int blockSize = 16 * chunkSize;
+
+	Rig::Rig() : num_vertices(0), num_targets(0), stride(0), data(NULL), half_deltas(NULL) {}
+
+	float* allocate(size_t count)
+	{
+#ifdef _MSC_VER
+		return (float*)_aligned_malloc(count * sizeof(float), 64);
+#else
+		void* data = NULL;
+		if (posix_memalign(&data, 64, count * sizeof(float)) != 0) return NULL;
+		return (float*)data;
+#endif
+	}
+
+	void release(float* data)
+	{
+#ifdef _MSC_VER
+		_aligned_free(data);
+#else
+		free(data);
+#endif
+	}
+
+	size_t meshSize(const Rig& rig)
+	{
+		return (size_t)rig.stride * 6;
+	}
+
+	/* scatter interleaved xyz positions and normals into the 6 arrays of a mesh */
+	static void deinterleave(const Rig& rig, const float* positions, const float* normals, float* mesh)
+	{
+		memset(mesh, 0, sizeof(float) * meshSize(rig));
+		for (int v = 0; v < rig.num_vertices; v++)
+		{
+			for (int c = 0; c < 3; c++)
+			{
+				mesh[c * rig.stride + v] = positions[v * 3 + c];
+				mesh[(c + 3) * rig.stride + v] = normals[v * 3 + c];
+			}
+		}
+	}
+
+	void create(Rig& rig, const float* positions, const float* normals, int num_vertices, int num_targets)
+	{
+		rig.num_vertices = num_vertices;
+		rig.num_targets = num_targets;
+		rig.stride = (num_vertices + 15) & ~15;
+		size_t size = meshSize(rig) * (num_targets + 1);
+		rig.data = allocate(size);
+		memset(rig.data, 0, sizeof(float) * size);
+		deinterleave(rig, positions, normals, rig.data);
+	}
+
+	void destroy(Rig& rig)
+	{
+		release(rig.data);
+		release((float*)rig.half_deltas);
+		rig = Rig();
+	}
+
+	/* convert the float deltas of a target to its half ones */
+	static void halveTarget(Rig& rig, int target)
+	{
+		size_t size = meshSize(rig);
+		SimdKernels::get().toHalf(rig.data + size * (target + 1), size, rig.half_deltas + size * target);
+	}
+
+	void setTarget(Rig& rig, int target, const float* bs_positions, const float* bs_normals)
+	{
+		deinterleave(rig, bs_positions, bs_normals, rig.data + meshSize(rig) * (target + 1));
+		if (rig.half_deltas != NULL) halveTarget(rig, target);
+	}
+
+	void setHalfPrecision(Rig& rig, bool enable)
+	{
+		if (enable == (rig.half_deltas != NULL)) return;
+		if (!enable)
+		{
+			release((float*)rig.half_deltas);
+			rig.half_deltas = NULL;
+			return;
+		}
+		//two halves per float, meshSize is even
+		rig.half_deltas = (unsigned short*)allocate(meshSize(rig) / 2 * rig.num_targets);
+		for (int t = 0; t < rig.num_targets; t++) halveTarget(rig, t);
+	}
+
+	static void blendChunk(const float* base, const float* const* deltas, const float* weights, int num_active,
+		size_t offset, float* out, int count)
+	{
+		const SimdKernels::Table& kernels = SimdKernels::get();
+		SimdKernels::BlendChunk kernel = num_active <= SimdKernels::maxUnrolled ?
+			kernels.blendChunk[num_active] : kernels.blendChunkGeneric;
+		kernel(base, deltas, weights, num_active, offset, out, count);
+	}
+
+	static void blendChunk(const float* base, const SimdKernels::half* const* deltas, const float* weights, int num_active,
+		size_t offset, float* out, int count)
+	{
+		const SimdKernels::Table& kernels = SimdKernels::get();
+		SimdKernels::BlendChunkHalf kernel = num_active <= SimdKernels::maxUnrolled ?
+			kernels.blendChunkHalf[num_active] : kernels.blendChunkGenericHalf;
+		kernel(base, deltas, weights, num_active, offset, out, count);
+	}
+
+	/**
+	 * The mesh a blend starts from and the targets of a job that have a
+	 * weight, with their half deltas when the rig has them.
+	 */
+	struct ActiveTargets
+	{
+		const float* base;
+		std::vector<const float*> deltas;
+		std::vector<const SimdKernels::half*> half_deltas;
+		std::vector<float> weights;
+	};
+
+	static void addActive(const Rig& rig, int target, float weight, ActiveTargets& active)
+	{
+		active.deltas.push_back(rig.data + meshSize(rig) * (target + 1));
+		if (rig.half_deltas != NULL) active.half_deltas.push_back(rig.half_deltas + meshSize(rig) * target);
+		active.weights.push_back(weight);
+	}
+
+	static void findActive(const Rig& rig, const float* weights, ActiveTargets& active)
+	{
+		active.base = rig.data;
+		for (int t = 0; t < rig.num_targets; t++)
+		{
+			if (weights[t] != 0.0f) addActive(rig, t, weights[t], active);
+		}
+	}
+
+	/* blend the floats [first, last) of a mesh */
+	static void blendRange(const ActiveTargets& active, float* out, int first, int last)
+	{
+		int num_active = (int)active.weights.size();
+		for (; first < last; first += chunkSize)
+		{
+			int count = last - first < chunkSize ? last - first : chunkSize;
+			const float* w = num_active > 0 ? &active.weights[0] : NULL;
+			if (!active.half_deltas.empty())
+				blendChunk(active.base + first, &active.half_deltas[0], w, num_active, first, out + first, count);
+			else
+				blendChunk(active.base + first, num_active > 0 ? &active.deltas[0] : NULL, w, num_active, first, out + first, count);
+		}
+	}
+
+	void evaluate(const Rig& rig, const float* weights, float* out)
+	{
+		ActiveTargets active;
+		findActive(rig, weights, active);
+		blendRange(active, out, 0, (int)meshSize(rig));
+	}
+
+	/* queue the blend of a whole mesh in blocks */
+	static void runBlocks(const Rig& rig, const ActiveTargets* active, float* out, ThreadPool::TaskGroup& group)
+	{
+		int size = (int)meshSize(rig);
+		for (int first = 0; first < size; first += blockSize)
+		{
+			int last = size - first < blockSize ? size : first + blockSize;
+			group.run([active, out, first, last]() { blendRange(*active, out, first, last); });
+		}
+	}
+
+	void evaluateAll(const Job* jobs, int num_jobs)
+	{
+		std::vector<ActiveTargets> active(num_jobs);
+		ThreadPool::TaskGroup group;
+		for (int j = 0; j < num_jobs; j++)
+		{
+			findActive(*jobs[j].rig, jobs[j].weights, active[j]);
+			runBlocks(*jobs[j].rig, &active[j], jobs[j].out, group);
+		}
+		group.wait();
+	}
+
+	void evaluateParallel(const Rig& rig, const float* weights, float* out)
+	{
+		Job job = { &rig, weights, out };
+		evaluateAll(&job, 1);
+	}
+
+	void halfError(const Rig& rig, const float* weights, float& position_error, float& normal_error)
+	{
+		position_error = normal_error = 0.0f;
+		if (rig.half_deltas == NULL) return;
+		Rig single = rig;
+		single.half_deltas = NULL;
+		size_t size = meshSize(rig);
+		float* reference = allocate(size);
+		float* blended = allocate(size);
+		evaluateParallel(single, weights, reference);
+		evaluateParallel(rig, weights, blended);
+		for (size_t i = 0; i < size; i++)
+		{
+			float& error = i < size / 2 ? position_error : normal_error;
+			error = std::max(error, std::fabs(blended[i] - reference[i]));
+		}
+		release(reference);
+		release(blended);
+	}
+
+	/* incremental updates between two full blends, which drop the rounding errors they accumulated */
+	static const int renormalizeInterval = 256;
+
+	Incremental::Incremental() : mesh(NULL), updates(0) {}
+
+	void create(const Rig& rig, Incremental& state)
+	{
+		state.mesh = allocate(meshSize(rig));
+		state.weights.clear();
+		state.updates = 0;
+	}
+
+	void destroy(Incremental& state)
+	{
+		release(state.mesh);
+		state = Incremental();
+	}
+
+	void invalidate(Incremental& state)
+	{
+		state.weights.clear();
+	}
+
+	int update(const Rig& rig, const float* weights, Incremental& state)
+	{
+		int K = rig.num_targets;
+		if ((int)state.weights.size() != K || state.updates >= renormalizeInterval)
+		{
+			evaluateParallel(rig, weights, state.mesh);
+			state.weights.assign(weights, weights + K);
+			state.updates = 0;
+			return K;
+		}
+
+		//add (new - old) * delta of the targets that moved, onto the mesh itself
+		ActiveTargets changed;
+		changed.base = state.mesh;
+		for (int t = 0; t < K; t++)
+		{
+			if (weights[t] == state.weights[t]) continue;
+			addActive(rig, t, weights[t] - state.weights[t], changed);
+			state.weights[t] = weights[t];
+		}
+		if (changed.weights.empty()) return 0;
+
+		ThreadPool::TaskGroup group;
+		runBlocks(rig, &changed, state.mesh, group);
+		group.wait();
+		state.updates++;
+		return (int)changed.weights.size();
+	}
+
+	/* blend num_frames (1 or frameGroup) frames of the floats [first, last) */
+	static void blendFrames(const Rig& rig, int num_frames, const float* weights, float* const* outs, int first, int last)
+	{
+		const SimdKernels::Table& kernels = SimdKernels::get();
+		size_t size = meshSize(rig);
+		if (rig.half_deltas != NULL)
+			kernels.blendFramesHalf[num_frames](rig.data, rig.half_deltas, size, rig.num_targets, weights, outs, first, last);
+		else
+			kernels.blendFrames[num_frames](rig.data, rig.data + size, size, rig.num_targets, weights, outs, first, last);
+	}
+
+	void evaluateFrames(const Rig& rig, const float* weights, int num_frames, int tile_frames, const FrameSink& sink)
+	{
+		if (num_frames <= 0) return;
+		if (tile_frames < 1) tile_frames = 1;
+		if (tile_frames > num_frames) tile_frames = num_frames;
+		int K = rig.num_targets;
+		int size = (int)meshSize(rig);
+
+		//a block of vertex data across all targets (16 KB per target at most) stays in L2 for the whole tile
+		int block = 32768 / (K > 0 ? K : 1);
+		block = block < 64 ? 64 : (block > 4096 ? 4096 : block);
+		block &= ~31;
+
+		float* tile = allocate((size_t)size * tile_frames);
+		std::vector<float> tile_weights((size_t)tile_frames * K);
+		for (int first_frame = 0; first_frame < num_frames; first_frame += tile_frames)
+		{
+			int count = num_frames - first_frame < tile_frames ? num_frames - first_frame : tile_frames;
+
+			//frame major, so the weights of a frame are contiguous
+			for (int f = 0; f < count; f++)
+			{
+				for (int t = 0; t < K; t++)
+					tile_weights[(size_t)f * K + t] = weights[(size_t)t * num_frames + first_frame + f];
+			}
+
+			const float* w = tile_weights.empty() ? NULL : &tile_weights[0];
+			int num_blocks = (size + block - 1) / block;
+			ThreadPool::parallelFor(0, num_blocks, 1, [&](int first_block, int last_block) {
+				for (int b = first_block; b < last_block; b++)
+				{
+					int first = b * block;
+					int last = first + block < size ? first + block : size;
+					float* outs[SimdKernels::frameGroup];
+					int f = 0;
+					for (; f + SimdKernels::frameGroup <= count; f += SimdKernels::frameGroup)
+					{
+						for (int g = 0; g < SimdKernels::frameGroup; g++) outs[g] = tile + (size_t)size * (f + g);
+						blendFrames(rig, SimdKernels::frameGroup, w + (size_t)f * K, outs, first, last);
+					}
+					for (; f < count; f++)
+					{
+						outs[0] = tile + (size_t)size * f;
+						blendFrames(rig, 1, w + (size_t)f * K, outs, first, last);
+					}
+				}
+			});
+
+			sink(first_frame, count, tile);
+		}
+		release(tile);
+	}
+
+	void interleave(const Rig& rig, const float* mesh, float* positions, float* normals)
+	{
+		for (int v = 0; v < rig.num_vertices; v++)
+		{
+			for (int c = 0; c < 3; c++)
+			{
+				positions[v * 3 + c] = mesh[c * rig.stride + v];
+				normals[v * 3 + c] = mesh[(c + 3) * rig.stride + v];
+			}
+		}
+	}
+}
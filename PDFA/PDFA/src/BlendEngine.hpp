@@ -0,0 +1,128 @@
+//
+//  BlendEngine.hpp
+//  PDFA
+//
+
+#ifndef BlendEngine_hpp
+#define BlendEngine_hpp
+
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+/**
+ * BlendEngine
+ * CPU blendshape evaluation, neutral + sum of weight * delta, for when no GL
+ * context is around or the blended mesh is needed on the CPU. The rig is
+ * kept as structure of arrays so the kernels run on 4 (SSE), 8 (AVX) or
+ * 16 (AVX-512) vertices per instruction, picked at startup (SimdKernels).
+ */
+namespace BlendEngine
+{
+	/**
+	 * Every mesh (the neutral one, then the deltas of each target) is stored
+	 * as 6 arrays x, y, z, nx, ny, nz of stride floats, one after the other,
+	 * so a whole mesh is one array of 6 * stride floats.
+	 */
+	struct Rig
+	{
+		int num_vertices;
+		int num_targets;
+		int stride;             //num_vertices rounded up to a multiple of 16
+		float* data;            //(num_targets + 1) meshes, 64-byte aligned
+		unsigned short* half_deltas;    //the num_targets deltas as fp16 if half precision is on, else NULL
+		Rig();
+	};
+
+	/* 64-byte aligned float arrays, for the rig and the blended meshes */
+	float* allocate(size_t count);
+	void release(float* data);
+
+	/* allocate the rig with the neutral mesh and all deltas zero, positions and normals are interleaved xyz */
+	void create(Rig& rig, const float* positions, const float* normals, int num_vertices, int num_targets);
+	void destroy(Rig& rig);
+
+	/* set the dense interleaved deltas of a target */
+	void setTarget(Rig& rig, int target, const float* bs_positions, const float* bs_normals);
+
+	/**
+	 * Keep a half precision copy of the deltas and blend it instead of the
+	 * float one, converting on the fly and accumulating in floats. The
+	 * kernels read half the bytes per target, which is what bounds them on
+	 * rigs larger than the caches. The neutral mesh stays in floats. Below
+	 * CpuFeatures::AVX2 there is no F16C and the conversion costs more than
+	 * it saves.
+	 */
+	void setHalfPrecision(Rig& rig, bool enable);
+
+	/* floats in a blended mesh, allocate the output of evaluate with it */
+	size_t meshSize(const Rig& rig);
+
+	/**
+	 * Blend the rig into out, a mesh in the layout of the rig. Zero weights
+	 * are skipped. Normals are not renormalized.
+	 */
+	void evaluate(const Rig& rig, const float* weights, float* out);
+
+	/* a character to blend with evaluateAll */
+	struct Job
+	{
+		const Rig* rig;
+		const float* weights;
+		float* out;
+	};
+
+	/**
+	 * Blend several characters on the thread pool. Every mesh is split in
+	 * blocks that fit the L2 cache, so the work spreads over the cores both
+	 * for one large rig and for many small ones.
+	 */
+	void evaluateAll(const Job* jobs, int num_jobs);
+
+	/* evaluate on the thread pool */
+	void evaluateParallel(const Rig& rig, const float* weights, float* out);
+
+	/* largest difference of the positions and normals blended from the half deltas to the float ones, 0 without */
+	void halfError(const Rig& rig, const float* weights, float& position_error, float& normal_error);
+
+	/**
+	 * A blended mesh kept up to date by adding (new weight - old weight) *
+	 * delta for the targets whose weight changed, so the cost follows the
+	 * number of weights that moved rather than the size of the rig. Every few
+	 * hundred updates the mesh is blended from scratch to bound the drift.
+	 */
+	struct Incremental
+	{
+		float* mesh;                    //in the layout of the rig
+		std::vector<float> weights;     //the weights of mesh, empty when it must be blended from scratch
+		int updates;                    //incremental updates since the last full blend
+		Incremental();
+	};
+
+	void create(const Rig& rig, Incremental& state);
+	void destroy(Incremental& state);
+
+	/* force a full blend on the next update, after the deltas of the rig changed */
+	void invalidate(Incremental& state);
+
+	/* bring state.mesh to weights, returns the number of targets blended, 0 if nothing changed */
+	int update(const Rig& rig, const float* weights, Incremental& state);
+
+	/* receives the meshes of frames [first_frame, first_frame + num_frames) one after the other */
+	typedef std::function<void(int first_frame, int num_frames, const float* meshes)> FrameSink;
+
+	/**
+	 * Blend a sequence of frames, weights being the num_targets x num_frames
+	 * matrix of target weights (weights[target * num_frames + frame]). This is
+	 * a blocked matrix multiply of the deltas by the weights: every block of
+	 * deltas is loaded once per tile of frames instead of once per frame.
+	 * The meshes are passed to sink tile_frames at a time, so memory stays
+	 * bounded for any number of frames.
+	 */
+	void evaluateFrames(const Rig& rig, const float* weights, int num_frames, int tile_frames, const FrameSink& sink);
+
+	/* convert a blended mesh to interleaved xyz positions and normals */
+	void interleave(const Rig& rig, const float* mesh, float* positions, float* normals);
+}
+
+#endif /* BlendEngine_hpp */
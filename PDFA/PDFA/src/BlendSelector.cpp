@@ -0,0 +1,108 @@
+//
+//  BlendSelector.cpp
+//  PDFA
+//
+
+#include "BlendSelector.hpp"
+#include "SimdKernels.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+namespace BlendSelector
+{
+	/* runs of every measurement, the fastest one is kept */
+	static const int repetitions = 5;
+
+	Costs::Costs() : sparse_base(0.0), sparse_per_delta(0.0) {}
+
+	template <typename F>
+	static double fastest(F run)
+	{
+		double best = 1e30;
+		for (int i = 0; i < repetitions; i++)
+		{
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			run();
+			best = std::min(best, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+		}
+		return best;
+	}
+
+	void calibrate(const BlendEngine::Rig& rig, const float* positions, const float* normals, Costs& costs)
+	{
+		int nv = rig.num_vertices;
+		int K = rig.num_targets;
+		std::vector<float> out_positions((size_t)nv * 3), out_normals((size_t)nv * 3);
+		float* mesh = BlendEngine::allocate(BlendEngine::meshSize(rig));
+
+		//the dense pass skips zero weights, so all zero is its fixed cost; the
+		//unrolled kernels differ from the generic one, so time each of their
+		//counts, then every doubling up to all the targets
+		std::vector<int>& counts = costs.dense_targets;
+		counts.clear();
+		for (int n = 0; n <= std::min(K, SimdKernels::maxUnrolled); n++) counts.push_back(n);
+		for (int n = 2 * SimdKernels::maxUnrolled; n < K; n *= 2) counts.push_back(n);
+		if (K > SimdKernels::maxUnrolled) counts.push_back(K);
+
+		costs.dense_times.clear();
+		for (size_t i = 0; i < counts.size(); i++)
+		{
+			std::vector<float> weights(K > 0 ? K : 1, 0.0f);
+			std::fill(weights.begin(), weights.begin() + counts[i], 1.0f);
+			costs.dense_times.push_back(fastest([&]() {
+				BlendEngine::evaluateParallel(rig, &weights[0], mesh);
+				BlendEngine::interleave(rig, mesh, &out_positions[0], &out_normals[0]);
+			}));
+		}
+
+		//a target moving every vertex, its delta values do not matter
+		BlendShapes::SparseTarget full;
+		full.vertices.resize(nv);
+		for (int v = 0; v < nv; v++) full.vertices[v] = (unsigned int)v;
+		full.deltas.assign((size_t)nv * 6, 0.001f);
+		float w0 = 0.0f, w1 = 1.0f;
+		costs.sparse_base = fastest([&]() {
+			BlendShapes::evaluate(positions, normals, nv, &full, &w0, 1, &out_positions[0], &out_normals[0]);
+		});
+		double sparse_full = fastest([&]() {
+			BlendShapes::evaluate(positions, normals, nv, &full, &w1, 1, &out_positions[0], &out_normals[0]);
+		});
+		costs.sparse_per_delta = nv > 0 ? std::max(sparse_full - costs.sparse_base, 0.0) / nv : 0.0;
+
+		BlendEngine::release(mesh);
+	}
+
+	double denseTime(const Costs& costs, int active)
+	{
+		const std::vector<int>& n = costs.dense_targets;
+		const std::vector<double>& t = costs.dense_times;
+		if (n.empty()) return 0.0;
+		if (n.size() == 1 || active <= n[0]) return t[0];
+
+		//the segment holding active, the last one past the largest count
+		size_t i = std::lower_bound(n.begin(), n.end(), active) - n.begin();
+		if (i == n.size()) i--;
+		return t[i - 1] + (t[i] - t[i - 1]) * (active - n[i - 1]) / (n[i] - n[i - 1]);
+	}
+
+	Kernel choose(const Costs& costs, const BlendShapes::SparseTarget* targets, const float* weights, int num_targets,
+		double* dense_time, double* sparse_time)
+	{
+		int active = 0;
+		size_t deltas = 0;
+		for (int t = 0; t < num_targets; t++)
+		{
+			if (weights[t] == 0.0f) continue;
+			active++;
+			deltas += targets[t].vertices.size();
+		}
+
+		double dense = denseTime(costs, active);
+		double sparse = costs.sparse_base + costs.sparse_per_delta * deltas;
+		if (dense_time) *dense_time = dense;
+		if (sparse_time) *sparse_time = sparse;
+		return sparse < dense ? SPARSE : DENSE;
+	}
+}
@@ -0,0 +1,53 @@
+//
+//  BlendSelector.hpp
+//  PDFA
+//
+
+#ifndef BlendSelector_hpp
+#define BlendSelector_hpp
+
+#include "BlendEngine.hpp"
+#include "BlendShapes.hpp"
+
+#include <vector>
+
+/**
+ * BlendSelector
+ * Picks, frame by frame, the cheaper of the two CPU blends: the dense
+ * BlendEngine pass, whose cost grows with the number of active targets
+ * times the size of the mesh, and the sparse BlendShapes pass, whose cost
+ * grows with the number of deltas the active targets keep. The costs of
+ * both are measured once on the rig by a short benchmark, the dense one at
+ * several numbers of active targets since its kernel is specialized by
+ * that number (SimdKernels).
+ */
+namespace BlendSelector
+{
+	enum Kernel
+	{
+		DENSE,
+		SPARSE
+	};
+
+	/* milliseconds, measured on this machine and this rig */
+	struct Costs
+	{
+		std::vector<int> dense_targets;     //active targets the dense pass was timed with, increasing from 0
+		std::vector<double> dense_times;    //at each, 0 active being the copy of the neutral mesh and interleaving
+		double sparse_base;         //copy of the neutral mesh
+		double sparse_per_delta;    //per vertex kept by a target
+		Costs();
+	};
+
+	/* time both kernels on the neutral mesh of rig, the deltas of the rig are not used */
+	void calibrate(const BlendEngine::Rig& rig, const float* positions, const float* normals, Costs& costs);
+
+	/* time of the dense pass with active targets, interpolated between the measured ones */
+	double denseTime(const Costs& costs, int active);
+
+	/* the cheaper kernel for these weights, with the estimated time of each */
+	Kernel choose(const Costs& costs, const BlendShapes::SparseTarget* targets, const float* weights, int num_targets,
+		double* dense_time = NULL, double* sparse_time = NULL);
+}
+
+#endif /* BlendSelector_hpp */
@@ -0,0 +1,444 @@
+//
+//  BlendShapes.cpp
+//  PDFA
+//
+
+#include "BlendShapes.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+namespace BlendShapes
+{
+	static inline float length(const float* v)
+	{
+		return std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+	}
+
+	SparseTarget::SparseTarget() : max_position_error(0.0f), max_normal_error(0.0f) {}
+
+	QuantizedTarget::QuantizedTarget() : bits(16), max_position_error(0.0f), max_normal_error(0.0f)
+	{
+		for (int k = 0; k < 3; k++)
+		{
+			position_scale[k] = normal_scale[k] = 0.0f;
+			position_offset[k] = normal_offset[k] = 0.0f;
+		}
+	}
+
+	LowRankBasis::LowRankBasis() : rank(0), num_targets(0), max_position_error(0.0f), max_normal_error(0.0f) {}
+
+	/* largest integer of a normalized signed attribute, q = c / qmax */
+	static inline int quantizedMax(int bits)
+	{
+		return bits == 8 ? 127 : 32767;
+	}
+
+	template <typename T>
+	static void quantizeArray(const float* data, int num_vertices, float* scale, float* offset,
+		std::vector<char>& out, float& max_error)
+	{
+		const float qmax = (float)quantizedMax((int)sizeof(T) * 8);
+
+		//center the range of every axis on zero
+		for (int k = 0; k < 3; k++)
+		{
+			float lo = 0.0f, hi = 0.0f;
+			for (int v = 0; v < num_vertices; v++)
+			{
+				lo = std::min(lo, data[v * 3 + k]);
+				hi = std::max(hi, data[v * 3 + k]);
+			}
+			offset[k] = 0.5f * (lo + hi);
+			scale[k] = 0.5f * (hi - lo);
+		}
+
+		out.resize(sizeof(T) * num_vertices * 3);
+		T* q = (T*)&out[0];
+		max_error = 0.0f;
+		for (int v = 0; v < num_vertices; v++)
+		{
+			float e[3];
+			for (int k = 0; k < 3; k++)
+			{
+				size_t i = (size_t)v * 3 + k;
+				float c = scale[k] > 0.0f ? (data[i] - offset[k]) / scale[k] * qmax : 0.0f;
+				c = std::min(std::max(c, -qmax), qmax);
+				q[i] = (T)(c < 0.0f ? c - 0.5f : c + 0.5f);
+				e[k] = offset[k] + scale[k] * ((float)q[i] / qmax) - data[i];
+			}
+			max_error = std::max(max_error, length(e));
+		}
+	}
+
+	template <typename T>
+	static void dequantizeArray(const std::vector<char>& in, int num_vertices, const float* scale,
+		const float* offset, float* data)
+	{
+		const float qmax = (float)quantizedMax((int)sizeof(T) * 8);
+		const T* q = (const T*)&in[0];
+		for (size_t i = 0; i < (size_t)num_vertices * 3; i += 3)
+		{
+			for (int k = 0; k < 3; k++) data[i + k] = offset[k] + scale[k] * ((float)q[i + k] / qmax);
+		}
+	}
+
+	void makeSparse(const float* bs_positions, const float* bs_normals, int num_vertices, float epsilon,
+		SparseTarget& target)
+	{
+		target.vertices.clear();
+		target.deltas.clear();
+		target.max_position_error = 0.0f;
+		target.max_normal_error = 0.0f;
+
+		for (int v = 0; v < num_vertices; v++)
+		{
+			const float* dp = bs_positions + (size_t)v * 3;
+			const float* dn = bs_normals + (size_t)v * 3;
+			float lp = length(dp);
+			float ln = length(dn);
+			if (lp <= epsilon && ln <= epsilon)
+			{
+				target.max_position_error = std::max(target.max_position_error, lp);
+				target.max_normal_error = std::max(target.max_normal_error, ln);
+				continue;
+			}
+			target.vertices.push_back((unsigned int)v);
+			target.deltas.insert(target.deltas.end(), dp, dp + 3);
+			target.deltas.insert(target.deltas.end(), dn, dn + 3);
+		}
+	}
+
+	void expand(const SparseTarget& target, int num_vertices, float* bs_positions, float* bs_normals)
+	{
+		memset(bs_positions, 0, sizeof(float) * num_vertices * 3);
+		memset(bs_normals, 0, sizeof(float) * num_vertices * 3);
+		for (size_t i = 0; i < target.vertices.size(); i++)
+		{
+			size_t v = target.vertices[i];
+			memcpy(bs_positions + v * 3, &target.deltas[i * 6], sizeof(float) * 3);
+			memcpy(bs_normals + v * 3, &target.deltas[i * 6 + 3], sizeof(float) * 3);
+		}
+	}
+
+	void quantize(const float* bs_positions, const float* bs_normals, int num_vertices, int bits,
+		QuantizedTarget& target)
+	{
+		target.bits = bits;
+		if (bits == 8)
+		{
+			quantizeArray<signed char>(bs_positions, num_vertices, target.position_scale, target.position_offset,
+				target.positions, target.max_position_error);
+			quantizeArray<signed char>(bs_normals, num_vertices, target.normal_scale, target.normal_offset,
+				target.normals, target.max_normal_error);
+		}
+		else
+		{
+			quantizeArray<short>(bs_positions, num_vertices, target.position_scale, target.position_offset,
+				target.positions, target.max_position_error);
+			quantizeArray<short>(bs_normals, num_vertices, target.normal_scale, target.normal_offset,
+				target.normals, target.max_normal_error);
+		}
+	}
+
+	void dequantize(const QuantizedTarget& target, int num_vertices, float* bs_positions, float* bs_normals)
+	{
+		if (target.bits == 8)
+		{
+			dequantizeArray<signed char>(target.positions, num_vertices, target.position_scale, target.position_offset, bs_positions);
+			dequantizeArray<signed char>(target.normals, num_vertices, target.normal_scale, target.normal_offset, bs_normals);
+		}
+		else
+		{
+			dequantizeArray<short>(target.positions, num_vertices, target.position_scale, target.position_offset, bs_positions);
+			dequantizeArray<short>(target.normals, num_vertices, target.normal_scale, target.normal_offset, bs_normals);
+		}
+	}
+
+	/**
+	 * out += w * (offset + scale * q / qmax), folded into a per-axis factor
+	 * and bias so decoding costs one multiply-add per component.
+	 */
+	template <typename T>
+	static void accumulateQuantized(const std::vector<char>& in, int num_vertices, float w, const float* scale,
+		const float* offset, float* out)
+	{
+		const float qmax = (float)quantizedMax((int)sizeof(T) * 8);
+		const T* q = (const T*)&in[0];
+		float f[3], b[3];
+		for (int k = 0; k < 3; k++)
+		{
+			f[k] = w * scale[k] / qmax;
+			b[k] = w * offset[k];
+		}
+		for (size_t i = 0; i < (size_t)num_vertices * 3; i += 3)
+		{
+			out[i + 0] += b[0] + f[0] * (float)q[i + 0];
+			out[i + 1] += b[1] + f[1] * (float)q[i + 1];
+			out[i + 2] += b[2] + f[2] * (float)q[i + 2];
+		}
+	}
+
+	void evaluate(const float* positions, const float* normals, int num_vertices,
+		const SparseTarget* targets, const float* weights, int num_targets,
+		float* out_positions, float* out_normals)
+	{
+		memcpy(out_positions, positions, sizeof(float) * num_vertices * 3);
+		memcpy(out_normals, normals, sizeof(float) * num_vertices * 3);
+		for (int t = 0; t < num_targets; t++)
+		{
+			float w = weights[t];
+			if (w == 0.0f) continue;
+
+			const SparseTarget& target = targets[t];
+			const float* d = target.deltas.empty() ? NULL : &target.deltas[0];
+			for (size_t i = 0; i < target.vertices.size(); i++, d += 6)
+			{
+				float* p = out_positions + (size_t)target.vertices[i] * 3;
+				float* n = out_normals + (size_t)target.vertices[i] * 3;
+				p[0] += w * d[0]; p[1] += w * d[1]; p[2] += w * d[2];
+				n[0] += w * d[3]; n[1] += w * d[4]; n[2] += w * d[5];
+			}
+		}
+	}
+
+	void evaluate(const float* positions, const float* normals, int num_vertices,
+		const QuantizedTarget* targets, const float* weights, int num_targets,
+		float* out_positions, float* out_normals)
+	{
+		memcpy(out_positions, positions, sizeof(float) * num_vertices * 3);
+		memcpy(out_normals, normals, sizeof(float) * num_vertices * 3);
+		for (int t = 0; t < num_targets; t++)
+		{
+			float w = weights[t];
+			if (w == 0.0f) continue;
+
+			const QuantizedTarget& target = targets[t];
+			if (target.bits == 8)
+			{
+				accumulateQuantized<signed char>(target.positions, num_vertices, w, target.position_scale, target.position_offset, out_positions);
+				accumulateQuantized<signed char>(target.normals, num_vertices, w, target.normal_scale, target.normal_offset, out_normals);
+			}
+			else
+			{
+				accumulateQuantized<short>(target.positions, num_vertices, w, target.position_scale, target.position_offset, out_positions);
+				accumulateQuantized<short>(target.normals, num_vertices, w, target.normal_scale, target.normal_offset, out_normals);
+			}
+		}
+	}
+
+	/**
+	 * Eigenvalues and eigenvectors of the symmetric n x n matrix a by cyclic
+	 * Jacobi rotations, sorted by decreasing eigenvalue. vectors is n x n,
+	 * one eigenvector per column.
+	 */
+	static void eigenSymmetric(std::vector<double> a, int n, std::vector<double>& values, std::vector<double>& vectors)
+	{
+		vectors.assign((size_t)n * n, 0.0);
+		for (int i = 0; i < n; i++) vectors[i * n + i] = 1.0;
+
+		for (int sweep = 0; sweep < 50; sweep++)
+		{
+			double off = 0.0;
+			for (int p = 0; p < n; p++)
+				for (int q = p + 1; q < n; q++) off += a[p * n + q] * a[p * n + q];
+			if (off < 1e-30) break;
+
+			for (int p = 0; p < n; p++)
+			{
+				for (int q = p + 1; q < n; q++)
+				{
+					if (a[p * n + q] == 0.0) continue;
+					double theta = (a[q * n + q] - a[p * n + p]) / (2.0 * a[p * n + q]);
+					double t = (theta >= 0.0 ? 1.0 : -1.0) / (std::fabs(theta) + std::sqrt(theta * theta + 1.0));
+					double c = 1.0 / std::sqrt(t * t + 1.0), s = t * c;
+					for (int k = 0; k < n; k++)
+					{
+						double akp = a[k * n + p], akq = a[k * n + q];
+						a[k * n + p] = c * akp - s * akq;
+						a[k * n + q] = s * akp + c * akq;
+					}
+					for (int k = 0; k < n; k++)
+					{
+						double apk = a[p * n + k], aqk = a[q * n + k];
+						a[p * n + k] = c * apk - s * aqk;
+						a[q * n + k] = s * apk + c * aqk;
+					}
+					for (int k = 0; k < n; k++)
+					{
+						double vkp = vectors[k * n + p], vkq = vectors[k * n + q];
+						vectors[k * n + p] = c * vkp - s * vkq;
+						vectors[k * n + q] = s * vkp + c * vkq;
+					}
+				}
+			}
+		}
+
+		std::vector<int> order(n);
+		for (int i = 0; i < n; i++) order[i] = i;
+		std::sort(order.begin(), order.end(), [&a, n](int i, int j) { return a[i * n + i] > a[j * n + j]; });
+		std::vector<double> sorted((size_t)n * n);
+		values.resize(n);
+		for (int i = 0; i < n; i++)
+		{
+			values[i] = a[order[i] * n + order[i]];
+			for (int k = 0; k < n; k++) sorted[k * n + i] = vectors[k * n + order[i]];
+		}
+		vectors.swap(sorted);
+	}
+
+	/* principal directions of the targets, the eigenvectors of the Gram matrix of the position deltas */
+	static void principalComponents(const float* const* bs_positions, int num_vertices, int num_targets,
+		std::vector<double>& values, std::vector<double>& vectors)
+	{
+		int K = num_targets;
+		size_t size = (size_t)num_vertices * 3;
+		std::vector<double> gram((size_t)K * K);
+		for (int i = 0; i < K; i++)
+		{
+			for (int j = i; j < K; j++)
+			{
+				double dot = 0.0;
+				for (size_t k = 0; k < size; k++) dot += (double)bs_positions[i][k] * bs_positions[j][k];
+				gram[i * K + j] = gram[j * K + i] = dot;
+			}
+		}
+		eigenSymmetric(gram, K, values, vectors);
+	}
+
+	/* basis i = deltas * vector i, coefficients = vector i, then the error of every rank */
+	static void buildBasis(const float* const* bs_positions, const float* const* bs_normals, int num_vertices,
+		int num_targets, const std::vector<double>& values, const std::vector<double>& vectors, LowRankBasis& basis)
+	{
+		int K = num_targets;
+		size_t size = (size_t)num_vertices * 3;
+		basis.num_targets = K;
+		basis.positions.assign(size * K, 0.0f);
+		basis.normals.assign(size * K, 0.0f);
+		basis.coefficients.resize((size_t)K * K);
+		basis.singular_values.resize(K);
+		for (int i = 0; i < K; i++) basis.singular_values[i] = (float)std::sqrt(std::max(values[i], 0.0));
+
+		for (int i = 0; i < K; i++)
+		{
+			float* p = &basis.positions[size * i];
+			float* n = &basis.normals[size * i];
+			for (int t = 0; t < K; t++)
+			{
+				float c = (float)vectors[t * K + i];
+				basis.coefficients[i * K + t] = c;
+				for (size_t k = 0; k < size; k++)
+				{
+					p[k] += c * bs_positions[t][k];
+					n[k] += c * bs_normals[t][k];
+				}
+			}
+		}
+
+		//reconstruct every target one component at a time, measuring the error after each
+		basis.position_errors.assign(K + 1, 0.0f);
+		basis.normal_errors.assign(K + 1, 0.0f);
+		std::vector<float> p(size), n(size);
+		for (int t = 0; t < K; t++)
+		{
+			std::fill(p.begin(), p.end(), 0.0f);
+			std::fill(n.begin(), n.end(), 0.0f);
+			for (int rank = 0; rank <= K; rank++)
+			{
+				if (rank > 0)
+				{
+					float c = basis.coefficients[(rank - 1) * K + t];
+					for (size_t k = 0; k < size; k++)
+					{
+						p[k] += c * basis.positions[size * (rank - 1) + k];
+						n[k] += c * basis.normals[size * (rank - 1) + k];
+					}
+				}
+				float& position_error = basis.position_errors[rank];
+				float& normal_error = basis.normal_errors[rank];
+				for (size_t k = 0; k < size; k += 3)
+				{
+					float e[3] = { p[k] - bs_positions[t][k], p[k + 1] - bs_positions[t][k + 1], p[k + 2] - bs_positions[t][k + 2] };
+					float f[3] = { n[k] - bs_normals[t][k], n[k + 1] - bs_normals[t][k + 1], n[k + 2] - bs_normals[t][k + 2] };
+					position_error = std::max(position_error, length(e));
+					normal_error = std::max(normal_error, length(f));
+				}
+			}
+		}
+	}
+
+	void factorize(const float* const* bs_positions, const float* const* bs_normals, int num_vertices, int num_targets,
+		LowRankBasis& basis)
+	{
+		std::vector<double> values, vectors;
+		principalComponents(bs_positions, num_vertices, num_targets, values, vectors);
+		buildBasis(bs_positions, bs_normals, num_vertices, num_targets, values, vectors, basis);
+		setRank(basis, num_targets);
+	}
+
+	void setRank(LowRankBasis& basis, int rank)
+	{
+		basis.rank = std::max(0, std::min(rank, basis.num_targets));
+		basis.max_position_error = basis.position_errors.empty() ? 0.0f : basis.position_errors[basis.rank];
+		basis.max_normal_error = basis.normal_errors.empty() ? 0.0f : basis.normal_errors[basis.rank];
+	}
+
+	void setRankForError(LowRankBasis& basis, float tolerance)
+	{
+		int rank = 0;
+		while (rank < basis.num_targets && basis.position_errors[rank] > tolerance) rank++;
+		setRank(basis, rank);
+	}
+
+	void basisWeights(const LowRankBasis& basis, const float* weights, float* basis_weights)
+	{
+		for (int i = 0; i < basis.num_targets; i++)
+		{
+			float w = 0.0f;
+			if (i < basis.rank)
+				for (int t = 0; t < basis.num_targets; t++) w += basis.coefficients[i * basis.num_targets + t] * weights[t];
+			basis_weights[i] = w;
+		}
+	}
+
+	void basisMesh(const LowRankBasis& basis, const float* const* bs_positions, const float* const* bs_normals,
+		int num_vertices, int i, float* positions, float* normals)
+	{
+		int K = basis.num_targets;
+		size_t size = (size_t)num_vertices * 3;
+		std::fill(positions, positions + size, 0.0f);
+		std::fill(normals, normals + size, 0.0f);
+		for (int t = 0; t < K; t++)
+		{
+			float c = basis.coefficients[i * K + t];
+			for (size_t k = 0; k < size; k++)
+			{
+				positions[k] += c * bs_positions[t][k];
+				normals[k] += c * bs_normals[t][k];
+			}
+		}
+	}
+
+	void evaluate(const float* positions, const float* normals, int num_vertices,
+		const LowRankBasis& basis, const float* weights,
+		float* out_positions, float* out_normals)
+	{
+		size_t size = (size_t)num_vertices * 3;
+		std::vector<float> w(basis.num_targets);
+		basisWeights(basis, weights, w.empty() ? NULL : &w[0]);
+		memcpy(out_positions, positions, sizeof(float) * size);
+		memcpy(out_normals, normals, sizeof(float) * size);
+		for (int i = 0; i < basis.rank; i++)
+		{
+			const float* p = &basis.positions[size * i];
+			const float* n = &basis.normals[size * i];
+			for (size_t k = 0; k < size; k++)
+			{
+				out_positions[k] += w[i] * p[k];
+				out_normals[k] += w[i] * n[k];
+			}
+		}
+	}
+}
@@ -0,0 +1,123 @@
+//
+//  BlendShapes.hpp
+//  PDFA
+//
+
+#ifndef BlendShapes_hpp
+#define BlendShapes_hpp
+
+#include <vector>
+
+/**
+ * BlendShapes
+ * Compact representations of the blendshape deltas of a rig and a reference
+ * CPU evaluator working on them. Dense deltas are stored target-major, three
+ * floats per vertex, as in the rig file.
+ */
+namespace BlendShapes
+{
+	/**
+	 * A target in sparse form: the vertices it moves, in increasing order,
+	 * and their position and normal deltas packed 6 floats per listed vertex.
+	 */
+	struct SparseTarget
+	{
+		std::vector<unsigned int> vertices;
+		std::vector<float> deltas;      //dx dy dz nx ny nz
+		float max_position_error;       //longest position delta that was dropped
+		float max_normal_error;         //longest normal delta that was dropped
+		SparseTarget();
+	};
+
+	/**
+	 * The dense deltas of a target as normalized 8 or 16 bit integers q in
+	 * [-1, 1], decoded per axis as offset + scale * q. This is the layout of
+	 * a normalized GL_BYTE / GL_SHORT vertex attribute.
+	 */
+	struct QuantizedTarget
+	{
+		int bits;
+		std::vector<char> positions;    //3 integers per vertex
+		std::vector<char> normals;
+		float position_scale[3];
+		float position_offset[3];
+		float normal_scale[3];
+		float normal_offset[3];
+		float max_position_error;       //longest difference between a decoded and an original delta
+		float max_normal_error;
+		QuantizedTarget();
+	};
+
+	/**
+	 * The deltas of all targets factored into basis meshes and, per target,
+	 * coefficients, the principal components of the position deltas. Target
+	 * t is approximated by the sum over the first rank i of
+	 * coefficients[i * num_targets + t] * basis mesh i, normals included.
+	 * All num_targets components are kept with the error of every rank, so
+	 * changing the rank does not factor again.
+	 */
+	struct LowRankBasis
+	{
+		int rank;                           //components blended, the first ones
+		int num_targets;                    //and components
+		std::vector<float> positions;       //num_targets meshes of position deltas, 3 floats per vertex, may be released
+		std::vector<float> normals;
+		std::vector<float> coefficients;    //num_targets x num_targets
+		std::vector<float> singular_values; //of every component, largest first
+		std::vector<float> position_errors; //longest difference between a reconstructed and an original delta,
+		std::vector<float> normal_errors;   //for every rank from 0 to num_targets
+		float max_position_error;           //at rank
+		float max_normal_error;
+		LowRankBasis();
+	};
+
+	/* keep the vertices whose position or normal delta is longer than epsilon */
+	void makeSparse(const float* bs_positions, const float* bs_normals, int num_vertices, float epsilon,
+		SparseTarget& target);
+
+	/* write the dense deltas of a sparse target, zero for the dropped vertices */
+	void expand(const SparseTarget& target, int num_vertices, float* bs_positions, float* bs_normals);
+
+	/* encode dense deltas with 8 or 16 bits per component, bounds are taken per target and axis */
+	void quantize(const float* bs_positions, const float* bs_normals, int num_vertices, int bits,
+		QuantizedTarget& target);
+
+	void dequantize(const QuantizedTarget& target, int num_vertices, float* bs_positions, float* bs_normals);
+
+	/* factor the dense deltas of num_targets targets into all their components, the rank is num_targets */
+	void factorize(const float* const* bs_positions, const float* const* bs_normals, int num_vertices, int num_targets,
+		LowRankBasis& basis);
+
+	/* blend the first rank components */
+	void setRank(LowRankBasis& basis, int rank);
+
+	/* the smallest rank whose position error is at most tolerance */
+	void setRankForError(LowRankBasis& basis, float tolerance);
+
+	/* the weights of the num_targets basis meshes for target weights, zero past the rank */
+	void basisWeights(const LowRankBasis& basis, const float* weights, float* basis_weights);
+
+	/* component i from the targets and the coefficients, for a basis whose meshes were released */
+	void basisMesh(const LowRankBasis& basis, const float* const* bs_positions, const float* const* bs_normals,
+		int num_vertices, int i, float* positions, float* normals);
+
+	/**
+	 * out = neutral + sum of weights[i] * targets[i], skipping zero weights.
+	 * The normals are not renormalized.
+	 */
+	void evaluate(const float* positions, const float* normals, int num_vertices,
+		const SparseTarget* targets, const float* weights, int num_targets,
+		float* out_positions, float* out_normals);
+
+	/* same as above for quantized targets, decoding the deltas on the fly */
+	void evaluate(const float* positions, const float* normals, int num_vertices,
+		const QuantizedTarget* targets, const float* weights, int num_targets,
+		float* out_positions, float* out_normals);
+
+	/* same as above with the low rank basis, blending rank meshes instead of num_targets */
+	void evaluate(const float* positions, const float* normals, int num_vertices,
+		const LowRankBasis& basis, const float* weights,
+		float* out_positions, float* out_normals);
+}
+
+#endif /* BlendShapes_hpp */
@@ -0,0 +1,142 @@
+//
+//  CpuFeatures.cpp
+//  PDFA
+//
+
+#include "CpuFeatures.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#ifndef _MSC_VER
+#include <strings.h>
+#endif
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define CPUFEATURES_X86 1
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+namespace CpuFeatures
+{
+	static const char* names[] = { "scalar", "sse2", "avx", "avx2", "avx512" };
+
+#if defined(CPUFEATURES_X86)
+	/* eax, ebx, ecx, edx of a CPUID leaf */
+	static void cpuid(int leaf, int subleaf, unsigned int* regs)
+	{
+#ifdef _MSC_VER
+		int r[4];
+		__cpuidex(r, leaf, subleaf);
+		for (int i = 0; i < 4; i++) regs[i] = (unsigned int)r[i];
+#else
+		__cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+	}
+
+	/* the register state the OS saves on context switches */
+	static unsigned long long xgetbv()
+	{
+#ifdef _MSC_VER
+		return _xgetbv(0);
+#else
+		unsigned int lo, hi;
+		__asm__ __volatile__("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+		return ((unsigned long long)hi << 32) | lo;
+#endif
+	}
+#endif
+
+	Level detect()
+	{
+#if defined(CPUFEATURES_X86)
+		unsigned int regs[4];
+		cpuid(0, 0, regs);
+		unsigned int max_leaf = regs[0];
+		cpuid(1, 0, regs);
+		bool sse2 = (regs[3] & (1u << 26)) != 0;
+		bool fma = (regs[2] & (1u << 12)) != 0;
+		bool osxsave = (regs[2] & (1u << 27)) != 0;
+		bool avx = (regs[2] & (1u << 28)) != 0;
+		bool f16c = (regs[2] & (1u << 29)) != 0;
+		if (!sse2) return SCALAR;
+
+		//the OS must save the YMM (and for AVX-512 the ZMM and mask) registers
+		unsigned long long xcr0 = osxsave ? xgetbv() : 0;
+		bool ymm = (xcr0 & 0x6) == 0x6;
+		bool zmm = (xcr0 & 0xe6) == 0xe6;
+		if (!avx || !ymm) return SSE2;
+
+		bool avx2 = false, avx512 = false;
+		if (max_leaf >= 7)
+		{
+			cpuid(7, 0, regs);
+			avx2 = (regs[1] & (1u << 5)) != 0;
+			avx512 = (regs[1] & (1u << 16)) != 0;
+		}
+		if (!avx2 || !fma || !f16c) return AVX;
+		if (!avx512 || !zmm) return AVX2;
+		return AVX512;
+#else
+		return SCALAR;
+#endif
+	}
+
+	static Level level = SCALAR;
+	static std::once_flag levelOnce;
+
+	static void select()
+	{
+		level = detect();
+		const char* text = getenv("PDFA_ISA");
+		if (text == NULL || *text == 0) return;
+
+		Level wanted;
+		if (!parse(text, wanted))
+		{
+			std::cerr << "PDFA_ISA: unknown instruction set " << text << ", using " << name(level) << std::endl;
+		}
+		else if (wanted > level)
+		{
+			std::cerr << "PDFA_ISA: " << text << " is not supported here, using " << name(level) << std::endl;
+		}
+		else
+		{
+			level = wanted;
+		}
+	}
+
+	Level selected()
+	{
+		std::call_once(levelOnce, select);
+		return level;
+	}
+
+	const char* name(Level level)
+	{
+		return names[level];
+	}
+
+	bool parse(const char* text, Level& level)
+	{
+		for (int i = 0; i <= AVX512; i++)
+		{
+#ifdef _MSC_VER
+			bool same = _stricmp(text, names[i]) == 0;
+#else
+			bool same = strcasecmp(text, names[i]) == 0;
+#endif
+			if (same)
+			{
+				level = (Level)i;
+				return true;
+			}
+		}
+		return false;
+	}
+}
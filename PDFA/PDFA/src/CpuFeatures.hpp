@@ -0,0 +1,40 @@
+//
+//  CpuFeatures.hpp
+//  PDFA
+//
+
+#ifndef CpuFeatures_hpp
+#define CpuFeatures_hpp
+
+/**
+ * CpuFeatures
+ * The instruction sets the processor and the OS support, read with CPUID,
+ * so a single binary can pick its SIMD kernels at startup. The PDFA_ISA
+ * environment variable (scalar, sse2, avx, avx2 or avx512) lowers the level,
+ * to compare the kernels on one machine.
+ */
+namespace CpuFeatures
+{
+	/* each level includes the ones below it */
+	enum Level
+	{
+		SCALAR,
+		SSE2,
+		AVX,
+		AVX2,       //with FMA and F16C
+		AVX512      //AVX-512F
+	};
+
+	/* the highest level supported */
+	Level detect();
+
+	/* the level to use: detect(), lowered by PDFA_ISA, decided on the first call */
+	Level selected();
+
+	const char* name(Level level);
+
+	/* parse a level name, returns false if unknown */
+	bool parse(const char* text, Level& level);
+}
+
+#endif /* CpuFeatures_hpp */
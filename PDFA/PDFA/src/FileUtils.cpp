@@ -0,0 +1,110 @@
+//
+//  FileUtils.cpp
+//  PDFA
+//
+
+#include "FileUtils.hpp"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace FileUtils
+{
+#ifdef _WIN32
+	MappedFile::MappedFile() : data(NULL), size(0), file(INVALID_HANDLE_VALUE), mapping(NULL) {}
+
+	bool mapFile(const char* filename, MappedFile& file)
+	{
+		file.file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL,
+			OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+		if (file.file == INVALID_HANDLE_VALUE) return false;
+
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(file.file, &size) || size.QuadPart == 0)
+		{
+			unmapFile(file);
+			return false;
+		}
+		file.size = (size_t)size.QuadPart;
+
+		file.mapping = CreateFileMappingA(file.file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (file.mapping == NULL)
+		{
+			unmapFile(file);
+			return false;
+		}
+
+		file.data = (const char*)MapViewOfFile(file.mapping, FILE_MAP_READ, 0, 0, 0);
+		if (file.data == NULL)
+		{
+			unmapFile(file);
+			return false;
+		}
+		return true;
+	}
+
+	void unmapFile(MappedFile& file)
+	{
+		if (file.data != NULL) UnmapViewOfFile(file.data);
+		if (file.mapping != NULL) CloseHandle(file.mapping);
+		if (file.file != INVALID_HANDLE_VALUE) CloseHandle(file.file);
+		file = MappedFile();
+	}
+
+	bool getModifiedTime(const char* filename, long long& time)
+	{
+		struct _stat64 st;
+		if (_stat64(filename, &st) != 0) return false;
+		time = (long long)st.st_mtime;
+		return true;
+	}
+#else
+	MappedFile::MappedFile() : data(NULL), size(0), fd(-1) {}
+
+	bool mapFile(const char* filename, MappedFile& file)
+	{
+		file.fd = open(filename, O_RDONLY);
+		if (file.fd < 0) return false;
+
+		struct stat st;
+		if (fstat(file.fd, &st) != 0 || st.st_size == 0)
+		{
+			unmapFile(file);
+			return false;
+		}
+		file.size = (size_t)st.st_size;
+
+		void* data = mmap(NULL, file.size, PROT_READ, MAP_PRIVATE, file.fd, 0);
+		if (data == MAP_FAILED)
+		{
+			unmapFile(file);
+			return false;
+		}
+		file.data = (const char*)data;
+		return true;
+	}
+
+	void unmapFile(MappedFile& file)
+	{
+		if (file.data != NULL) munmap((void*)file.data, file.size);
+		if (file.fd >= 0) close(file.fd);
+		file = MappedFile();
+	}
+
+	bool getModifiedTime(const char* filename, long long& time)
+	{
+		struct stat st;
+		if (stat(filename, &st) != 0) return false;
+		time = (long long)st.st_mtime;
+		return true;
+	}
+#endif
+}
@@ -0,0 +1,38 @@
+//
+//  FileUtils.hpp
+//  PDFA
+//
+
+#ifndef FileUtils_hpp
+#define FileUtils_hpp
+
+#include <cstddef>
+
+/**
+ * FileUtils
+ * Read-only memory mapping and file time stamps.
+ */
+namespace FileUtils
+{
+	struct MappedFile
+	{
+		const char* data;
+		size_t size;
+#ifdef _WIN32
+		void* file;
+		void* mapping;
+#else
+		int fd;
+#endif
+		MappedFile();
+	};
+
+	/* map the whole file read-only, returns false if it cannot be opened */
+	bool mapFile(const char* filename, MappedFile& file);
+	void unmapFile(MappedFile& file);
+
+	/* last modification time of the file, returns false if it does not exist */
+	bool getModifiedTime(const char* filename, long long& time);
+}
+
+#endif /* FileUtils_hpp */
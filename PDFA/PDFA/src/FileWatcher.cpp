@@ -0,0 +1,158 @@
+//
+//  FileWatcher.cpp
+//  PDFA
+//
+
+#include "FileWatcher.hpp"
+#include "FileUtils.hpp"
+
+#include <algorithm>
+#include <string>
+
+#if defined(_WIN32)
+#include <Windows.h>
+#elif defined(__linux__)
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace FileWatcher
+{
+	struct Watch
+	{
+		std::vector<std::string> files;
+		std::vector<std::string> names;     //file name without the directory
+		std::vector<int> file_dir;          //index in dirs of the directory of every file
+		std::vector<std::string> dirs;
+		std::vector<long long> times;       //last modification time seen, where time stamps are compared
+#if defined(_WIN32)
+		std::vector<HANDLE> handles;        //one change notification per directory
+#elif defined(__linux__)
+		int fd;
+		std::vector<int> wds;               //one inotify watch per directory
+#endif
+	};
+
+	static void addChanged(std::vector<int>& changed, int file)
+	{
+		if (std::find(changed.begin(), changed.end(), file) == changed.end()) changed.push_back(file);
+	}
+
+#ifndef __linux__
+	/* report the files of a directory (or all of them if dir < 0) whose time stamp moved */
+	static void compareTimes(Watch* watch, int dir, std::vector<int>& changed)
+	{
+		for (size_t i = 0; i < watch->files.size(); i++)
+		{
+			if (dir >= 0 && watch->file_dir[i] != dir) continue;
+			long long time = 0;
+			if (!FileUtils::getModifiedTime(watch->files[i].c_str(), time) || time == watch->times[i]) continue;
+			watch->times[i] = time;
+			addChanged(changed, (int)i);
+		}
+	}
+#endif
+
+	Watch* open(const char* const* filenames, int num_files)
+	{
+		Watch* watch = new Watch();
+		for (int i = 0; i < num_files; i++)
+		{
+			std::string file = filenames[i];
+			size_t slash = file.find_last_of("/\\");
+			std::string dir = slash == std::string::npos ? "." : file.substr(0, slash);
+			std::string name = slash == std::string::npos ? file : file.substr(slash + 1);
+
+			std::vector<std::string>::iterator it = std::find(watch->dirs.begin(), watch->dirs.end(), dir);
+			if (it == watch->dirs.end()) it = watch->dirs.insert(it, dir);
+
+			long long time = 0;
+			FileUtils::getModifiedTime(file.c_str(), time);
+			watch->files.push_back(file);
+			watch->names.push_back(name);
+			watch->file_dir.push_back((int)(it - watch->dirs.begin()));
+			watch->times.push_back(time);
+		}
+
+#if defined(_WIN32)
+		for (size_t d = 0; d < watch->dirs.size(); d++)
+		{
+			HANDLE handle = FindFirstChangeNotificationA(watch->dirs[d].c_str(), FALSE,
+				FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME);
+			watch->handles.push_back(handle);
+			if (handle == INVALID_HANDLE_VALUE)
+			{
+				close(watch);
+				return NULL;
+			}
+		}
+#elif defined(__linux__)
+		watch->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if (watch->fd < 0)
+		{
+			close(watch);
+			return NULL;
+		}
+		for (size_t d = 0; d < watch->dirs.size(); d++)
+		{
+			int wd = inotify_add_watch(watch->fd, watch->dirs[d].c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+			watch->wds.push_back(wd);
+			if (wd < 0)
+			{
+				close(watch);
+				return NULL;
+			}
+		}
+#endif
+		return watch;
+	}
+
+	void poll(Watch* watch, std::vector<int>& changed)
+	{
+		if (watch == NULL) return;
+#if defined(_WIN32)
+		for (size_t d = 0; d < watch->handles.size(); d++)
+		{
+			if (WaitForSingleObject(watch->handles[d], 0) != WAIT_OBJECT_0) continue;
+			FindNextChangeNotification(watch->handles[d]);
+			compareTimes(watch, (int)d, changed);
+		}
+#elif defined(__linux__)
+		//events are variable length, a name follows every header
+		char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+		for (;;)
+		{
+			ssize_t length = read(watch->fd, buffer, sizeof(buffer));
+			if (length <= 0) break;
+			for (char* p = buffer; p < buffer + length; )
+			{
+				const struct inotify_event* event = (const struct inotify_event*)p;
+				p += sizeof(struct inotify_event) + event->len;
+				if (event->len == 0) continue;
+
+				int dir = (int)(std::find(watch->wds.begin(), watch->wds.end(), event->wd) - watch->wds.begin());
+				for (size_t i = 0; i < watch->files.size(); i++)
+				{
+					if (watch->file_dir[i] == dir && watch->names[i] == event->name) addChanged(changed, (int)i);
+				}
+			}
+		}
+#else
+		compareTimes(watch, -1, changed);
+#endif
+	}
+
+	void close(Watch* watch)
+	{
+		if (watch == NULL) return;
+#if defined(_WIN32)
+		for (size_t d = 0; d < watch->handles.size(); d++)
+		{
+			if (watch->handles[d] != INVALID_HANDLE_VALUE) FindCloseChangeNotification(watch->handles[d]);
+		}
+#elif defined(__linux__)
+		if (watch->fd >= 0) ::close(watch->fd);
+#endif
+		delete watch;
+	}
+}
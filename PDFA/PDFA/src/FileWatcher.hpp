@@ -0,0 +1,31 @@
+//
+//  FileWatcher.hpp
+//  PDFA
+//
+
+#ifndef FileWatcher_hpp
+#define FileWatcher_hpp
+
+#include <vector>
+
+/**
+ * FileWatcher
+ * Non-blocking notification of writes to a set of files, with inotify on
+ * Linux, directory change notifications on Windows and time stamp polling
+ * elsewhere. Files replaced by a rename, as many editors save, are reported
+ * as written.
+ */
+namespace FileWatcher
+{
+	struct Watch;
+
+	/* start watching the files, returns NULL if that is not possible */
+	Watch* open(const char* const* filenames, int num_files);
+
+	/* append the indices of the files written since the last call, never blocks */
+	void poll(Watch* watch, std::vector<int>& changed);
+
+	void close(Watch* watch);
+}
+
+#endif /* FileWatcher_hpp */
@@ -0,0 +1,91 @@
+//
+//  MeshNormals.cpp
+//  PDFA
+//
+
+#include "MeshNormals.hpp"
+#include "SimdKernels.hpp"
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+
+namespace MeshNormals
+{
+	/* triangles and vertices per parallel task */
+	static const int grain = 4096;
+
+	void buildAdjacency(const unsigned int* indices, int num_indices, const float* positions, int num_vertices,
+		Adjacency& adjacency)
+	{
+		//sort the vertices by position to find the ones that coincide
+		std::vector<int> order(num_vertices);
+		for (int v = 0; v < num_vertices; v++) order[v] = v;
+		std::sort(order.begin(), order.end(), [positions](int a, int b) {
+			const float* pa = positions + (size_t)a * 3;
+			const float* pb = positions + (size_t)b * 3;
+			if (pa[0] != pb[0]) return pa[0] < pb[0];
+			if (pa[1] != pb[1]) return pa[1] < pb[1];
+			if (pa[2] != pb[2]) return pa[2] < pb[2];
+			return a < b;
+		});
+		adjacency.welded.resize(num_vertices);
+		for (int i = 0; i < num_vertices; i++)
+		{
+			int v = order[i];
+			const float* p = positions + (size_t)v * 3;
+			const float* q = i > 0 ? positions + (size_t)order[i - 1] * 3 : NULL;
+			bool same = q != NULL && p[0] == q[0] && p[1] == q[1] && p[2] == q[2];
+			adjacency.welded[v] = same ? adjacency.welded[order[i - 1]] : v;
+		}
+
+		std::vector<int>& offsets = adjacency.offsets;
+		offsets.assign(num_vertices + 1, 0);
+		for (int i = 0; i < num_indices; i++) offsets[adjacency.welded[indices[i]] + 1]++;
+		for (int v = 0; v < num_vertices; v++) offsets[v + 1] += offsets[v];
+
+		adjacency.triangles.resize(num_indices);
+		std::vector<int> fill(offsets.begin(), offsets.end() - 1);
+		for (int i = 0; i < num_indices; i++) adjacency.triangles[fill[adjacency.welded[indices[i]]]++] = i / 3;
+	}
+
+	void compute(const Adjacency& adjacency, const unsigned int* indices, int num_indices,
+		const float* positions, int num_vertices, float* normals, std::vector<float>& face_normals)
+	{
+		int num_triangles = num_indices / 3;
+		face_normals.resize((size_t)num_triangles * 3);
+		float* faces = face_normals.empty() ? NULL : &face_normals[0];
+
+		//the cross product of two edges is the normal times twice the area
+		ThreadPool::parallelFor(0, num_triangles, grain, [&](int first, int last) {
+			for (int t = first; t < last; t++)
+			{
+				const float* a = positions + (size_t)indices[t * 3] * 3;
+				const float* b = positions + (size_t)indices[t * 3 + 1] * 3;
+				const float* c = positions + (size_t)indices[t * 3 + 2] * 3;
+				float e0[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+				float e1[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+				float* n = faces + (size_t)t * 3;
+				n[0] = e0[1] * e1[2] - e0[2] * e1[1];
+				n[1] = e0[2] * e1[0] - e0[0] * e1[2];
+				n[2] = e0[0] * e1[1] - e0[1] * e1[0];
+			}
+		});
+
+		//every vertex gathers its own triangles, so no two tasks write the same normal
+		ThreadPool::parallelFor(0, num_vertices, grain, [&](int first, int last) {
+			for (int v = first; v < last; v++)
+			{
+				int w = adjacency.welded[v];
+				float n[3] = { 0.0f, 0.0f, 0.0f };
+				for (int j = adjacency.offsets[w]; j < adjacency.offsets[w + 1]; j++)
+				{
+					const float* f = faces + (size_t)adjacency.triangles[j] * 3;
+					n[0] += f[0]; n[1] += f[1]; n[2] += f[2];
+				}
+				float* out = normals + (size_t)v * 3;
+				out[0] = n[0]; out[1] = n[1]; out[2] = n[2];
+			}
+			SimdKernels::get().normalize(normals + (size_t)first * 3, last - first);
+		});
+	}
+}
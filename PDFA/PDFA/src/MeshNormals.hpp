@@ -0,0 +1,45 @@
+//
+//  MeshNormals.hpp
+//  PDFA
+//
+
+#ifndef MeshNormals_hpp
+#define MeshNormals_hpp
+
+#include <vector>
+
+/**
+ * MeshNormals
+ * Vertex normals recomputed from deformed positions, as the normalized sum
+ * of the area weighted normals of the triangles around every vertex.
+ * Vertices at the same neutral position (split at texture seams) share
+ * their triangles so the seams stay smooth.
+ */
+namespace MeshNormals
+{
+	/**
+	 * The triangles around every vertex in compressed row form: the
+	 * triangles of vertex v are triangles[offsets[welded[v]]] up to
+	 * triangles[offsets[welded[v] + 1]], welded[v] being the first vertex at
+	 * the position of v.
+	 */
+	struct Adjacency
+	{
+		std::vector<int> welded;
+		std::vector<int> offsets;
+		std::vector<int> triangles;
+	};
+
+	/* built once from the neutral mesh, it holds for any deformation of it */
+	void buildAdjacency(const unsigned int* indices, int num_indices, const float* positions, int num_vertices,
+		Adjacency& adjacency);
+
+	/**
+	 * Write the normals of interleaved xyz positions, on the thread pool.
+	 * face_normals is scratch space kept by the caller between calls.
+	 */
+	void compute(const Adjacency& adjacency, const unsigned int* indices, int num_indices,
+		const float* positions, int num_vertices, float* normals, std::vector<float>& face_normals);
+}
+
+#endif /* MeshNormals_hpp */
@@ -0,0 +1,156 @@
+//
+//  MeshOptimizer.cpp
+//  PDFA
+//
+
+#include "MeshOptimizer.hpp"
+
+#include <cstring>
+
+namespace MeshOptimizer
+{
+	/* vertex to triangle adjacency in compressed row form */
+	static void buildAdjacency(const unsigned int* indices, int num_indices, int num_vertices,
+		std::vector<int>& offsets, std::vector<int>& triangles)
+	{
+		offsets.assign(num_vertices + 1, 0);
+		for (int i = 0; i < num_indices; i++) offsets[indices[i] + 1]++;
+		for (int v = 0; v < num_vertices; v++) offsets[v + 1] += offsets[v];
+
+		triangles.resize(num_indices);
+		std::vector<int> fill(offsets.begin(), offsets.end() - 1);
+		for (int i = 0; i < num_indices; i++) triangles[fill[indices[i]]++] = i / 3;
+	}
+
+	/**
+	 * Pick the next fanning vertex: the candidate that will still be in the
+	 * cache after its remaining triangles are emitted and has been there the
+	 * longest, else a vertex from the dead-end stack, else the next live
+	 * vertex in input order.
+	 */
+	static int getNextVertex(const std::vector<int>& candidates, const std::vector<int>& live,
+		const std::vector<int>& cache_time, int time, int cache_size,
+		std::vector<int>& dead_end, int& cursor, int num_vertices)
+	{
+		int best = -1;
+		int best_priority = -1;
+		for (size_t i = 0; i < candidates.size(); i++)
+		{
+			int v = candidates[i];
+			if (live[v] <= 0) continue;
+			int priority = 0;
+			if (time - cache_time[v] + 2 * live[v] <= cache_size) priority = time - cache_time[v];
+			if (priority > best_priority)
+			{
+				best = v;
+				best_priority = priority;
+			}
+		}
+		if (best >= 0) return best;
+
+		while (!dead_end.empty())
+		{
+			int v = dead_end.back();
+			dead_end.pop_back();
+			if (live[v] > 0) return v;
+		}
+
+		while (cursor < num_vertices)
+		{
+			if (live[cursor] > 0) return cursor;
+			cursor++;
+		}
+		return -1;
+	}
+
+	void optimizeVertexCache(unsigned int* indices, int num_indices, int num_vertices, int cache_size)
+	{
+		if (num_indices < 3 || num_vertices == 0) return;
+
+		std::vector<int> offsets, adjacency;
+		buildAdjacency(indices, num_indices, num_vertices, offsets, adjacency);
+
+		std::vector<int> live(num_vertices);
+		for (int v = 0; v < num_vertices; v++) live[v] = offsets[v + 1] - offsets[v];
+
+		int num_triangles = num_indices / 3;
+		std::vector<char> emitted(num_triangles, 0);
+		std::vector<int> cache_time(num_vertices, 0);
+		std::vector<int> dead_end;
+		std::vector<int> candidates;
+		std::vector<unsigned int> output;
+		output.reserve(num_indices);
+
+		int time = cache_size + 1;
+		int cursor = 1;
+		int fan = 0;
+		while (fan >= 0)
+		{
+			candidates.clear();
+			for (int j = offsets[fan]; j < offsets[fan + 1]; j++)
+			{
+				int t = adjacency[j];
+				if (emitted[t]) continue;
+				for (int k = 0; k < 3; k++)
+				{
+					int v = (int)indices[3 * t + k];
+					output.push_back((unsigned int)v);
+					dead_end.push_back(v);
+					candidates.push_back(v);
+					live[v]--;
+					if (time - cache_time[v] > cache_size) cache_time[v] = time++;
+				}
+				emitted[t] = 1;
+			}
+			fan = getNextVertex(candidates, live, cache_time, time, cache_size, dead_end, cursor, num_vertices);
+		}
+
+		memcpy(indices, &output[0], sizeof(unsigned int) * num_triangles * 3);
+	}
+
+	void optimizeVertexFetch(unsigned int* indices, int num_indices, int num_vertices, std::vector<unsigned int>& remap)
+	{
+		const unsigned int unused = 0xffffffffu;
+		remap.assign(num_vertices, unused);
+
+		unsigned int next = 0;
+		for (int i = 0; i < num_indices; i++)
+		{
+			unsigned int& r = remap[indices[i]];
+			if (r == unused) r = next++;
+			indices[i] = r;
+		}
+		for (int v = 0; v < num_vertices; v++)
+		{
+			if (remap[v] == unused) remap[v] = next++;
+		}
+	}
+
+	void remapVertices(float* data, int num_vertices, int components, const std::vector<unsigned int>& remap)
+	{
+		std::vector<float> copy(data, data + (size_t)num_vertices * components);
+		for (int v = 0; v < num_vertices; v++)
+		{
+			memcpy(data + (size_t)remap[v] * components, &copy[(size_t)v * components], sizeof(float) * components);
+		}
+	}
+
+	float averageCacheMissRatio(const unsigned int* indices, int num_indices, int num_vertices, int cache_size)
+	{
+		if (num_indices < 3) return 0.0f;
+
+		//a vertex is in the FIFO if it was pushed less than cache_size misses ago
+		std::vector<int> pushed(num_vertices, -cache_size - 1);
+		int misses = 0;
+		for (int i = 0; i < num_indices; i++)
+		{
+			unsigned int v = indices[i];
+			if (misses - pushed[v] > cache_size)
+			{
+				pushed[v] = misses;
+				misses++;
+			}
+		}
+		return (float)misses / (float)(num_indices / 3);
+	}
+}
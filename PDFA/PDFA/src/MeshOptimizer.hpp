@@ -0,0 +1,38 @@
+//
+//  MeshOptimizer.hpp
+//  PDFA
+//
+
+#ifndef MeshOptimizer_hpp
+#define MeshOptimizer_hpp
+
+#include <vector>
+
+/**
+ * MeshOptimizer
+ * Triangle and vertex reordering of indexed triangle lists for the
+ * post-transform vertex cache and for vertex fetch locality.
+ */
+namespace MeshOptimizer
+{
+	/**
+	 * Reorder the triangles in place with Tipsify (Sander, Nehab and Barczak,
+	 * "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw", 2007).
+	 */
+	void optimizeVertexCache(unsigned int* indices, int num_indices, int num_vertices, int cache_size = 16);
+
+	/**
+	 * Renumber the vertices in order of first use by the index buffer and
+	 * rewrite the indices. remap[old] is the new index of every vertex,
+	 * unreferenced vertices are moved to the end.
+	 */
+	void optimizeVertexFetch(unsigned int* indices, int num_indices, int num_vertices, std::vector<unsigned int>& remap);
+
+	/* move the elements of an array of num_vertices * components floats to their remapped places */
+	void remapVertices(float* data, int num_vertices, int components, const std::vector<unsigned int>& remap);
+
+	/* average cache miss ratio (transformed vertices per triangle) of a FIFO cache */
+	float averageCacheMissRatio(const unsigned int* indices, int num_indices, int num_vertices, int cache_size = 16);
+}
+
+#endif /* MeshOptimizer_hpp */
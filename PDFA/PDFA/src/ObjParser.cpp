@@ -0,0 +1,626 @@
+//
+//  ObjParser.cpp
+//  PDFA
+//
+
+#include "ObjParser.hpp"
+#include "FileUtils.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <sstream>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define OBJPARSER_SSE2 1
+#include <emmintrin.h>
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace ObjParser
+{
+	//the corner triples and their cache are tinyobj's, shared with its loader
+	using tinyobj::vertex_index;
+	using tinyobj::vertex_cache;
+
+	/* all the state of one parse, the vectors are reused across lines */
+	struct Parser
+	{
+		std::vector<float> v;
+		std::vector<float> vn;
+		std::vector<float> vt;
+		std::vector<vertex_index> corners;  //corners of the current face group
+		std::vector<int> face_sizes;        //number of corners of each face in the group
+		vertex_cache cache;
+		std::vector<unsigned int> direct;   //cache indexed by v_idx, see tinyobj::usesMatchingIndices
+		std::vector<int>* sources;          //if set, receives the triple of every emitted vertex
+		Topology topology;
+		bool triangulate;
+		bool faces;                         //false to only fingerprint the face lines
+	};
+
+	static const unsigned long long hashBasis = 14695981039346656037ULL;
+	static const unsigned long long hashPrime = 1099511628211ULL;
+
+	static inline unsigned long long hashInt(unsigned long long h, int value)
+	{
+		return (h ^ (unsigned int)value) * hashPrime;
+	}
+
+	Topology::Topology() : num_positions(0), num_texcoords(0), num_normals(0), num_faces(0), face_hash(hashBasis) {}
+
+	bool Topology::operator==(const Topology& other) const
+	{
+		return num_positions == other.num_positions && num_texcoords == other.num_texcoords
+			&& num_normals == other.num_normals && num_faces == other.num_faces
+			&& face_hash == other.face_hash;
+	}
+
+#define IS_SPACE( x ) ( ( (x) == ' ') || ( (x) == '\t') )
+#define IS_DIGIT( x ) ( (unsigned int)( (x) - '0' ) < (unsigned int)10 )
+
+	static inline int countTrailingZeros(unsigned int mask)
+	{
+#ifdef _MSC_VER
+		unsigned long index;
+		_BitScanForward(&index, mask);
+		return (int)index;
+#else
+		return __builtin_ctz(mask);
+#endif
+	}
+
+	/* position of the next '\n' at or after p, or end */
+	static inline const char* findLineEnd(const char* p, const char* end)
+	{
+#ifdef OBJPARSER_SSE2
+		const __m128i newline = _mm_set1_epi8('\n');
+		while (end - p >= 16)
+		{
+			__m128i chunk = _mm_loadu_si128((const __m128i*)p);
+			int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, newline));
+			if (mask != 0) return p + countTrailingZeros((unsigned int)mask);
+			p += 16;
+		}
+#endif
+		const char* q = (const char*)memchr(p, '\n', (size_t)(end - p));
+		return q ? q : end;
+	}
+
+	static inline const char* skipSpace(const char* p, const char* end)
+	{
+		while (p < end && IS_SPACE(*p)) p++;
+		return p;
+	}
+
+	static inline const char* skipToken(const char* p, const char* end)
+	{
+		while (p < end && !IS_SPACE(*p) && *p != '\r') p++;
+		return p;
+	}
+
+	static const double powersOf10[] =
+	{
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+	};
+
+	/**
+	 * Parse a float in [p, end) the way tinyobj does: sign, digits, optional
+	 * fraction and exponent, 0 if there is no number. Up to 19 significant
+	 * digits and a decimal exponent within +-22 are assembled exactly with
+	 * a single rounding, anything else goes through strtod.
+	 */
+	static inline float parseFloat(const char*& token, const char* end)
+	{
+		const char* p = skipSpace(token, end);
+		const char* start = p;
+		token = skipToken(p, end);
+
+		bool negative = false;
+		if (p < end && (*p == '+' || *p == '-'))
+		{
+			negative = *p == '-';
+			p++;
+		}
+		if (p >= end || !IS_DIGIT(*p)) return 0.0f;
+
+		unsigned long long mantissa = 0;
+		int digits = 0;
+		int exponent = 0;
+		while (p < end && IS_DIGIT(*p))
+		{
+			if (digits < 19) { mantissa = mantissa * 10 + (unsigned)(*p - '0'); if (mantissa) digits++; }
+			else exponent++;
+			p++;
+		}
+		if (p < end && *p == '.')
+		{
+			p++;
+			while (p < end && IS_DIGIT(*p))
+			{
+				if (digits < 19) { mantissa = mantissa * 10 + (unsigned)(*p - '0'); if (mantissa) digits++; exponent--; }
+				p++;
+			}
+		}
+		if (p < end && (*p == 'e' || *p == 'E'))
+		{
+			p++;
+			bool expNegative = false;
+			if (p < end && (*p == '+' || *p == '-'))
+			{
+				expNegative = *p == '-';
+				p++;
+			}
+			if (p >= end || !IS_DIGIT(*p)) return 0.0f; //empty exponent is a parse failure
+			int e = 0;
+			while (p < end && IS_DIGIT(*p))
+			{
+				if (e < 10000) e = e * 10 + (*p - '0');
+				p++;
+			}
+			exponent += expNegative ? -e : e;
+		}
+
+		double value;
+		if (mantissa < (1ULL << 53) && exponent >= -22 && exponent <= 22)
+		{
+			value = (double)mantissa;
+			value = exponent < 0 ? value / powersOf10[-exponent] : value * powersOf10[exponent];
+		}
+		else
+		{
+			char buffer[64];
+			size_t len = (size_t)(p - start);
+			if (len >= sizeof(buffer)) len = sizeof(buffer) - 1;
+			memcpy(buffer, start, len);
+			buffer[len] = 0;
+			value = strtod(buffer, NULL);
+			return (float)value;
+		}
+		return (float)(negative ? -value : value);
+	}
+
+	/* atoi() followed by a skip to the next '/', blank or end of line */
+	static inline int parseIndex(const char*& p, const char* end)
+	{
+		bool negative = false;
+		if (p < end && (*p == '+' || *p == '-'))
+		{
+			negative = *p == '-';
+			p++;
+		}
+		int i = 0;
+		while (p < end && IS_DIGIT(*p)) i = i * 10 + (*p++ - '0');
+		while (p < end && *p != '/' && !IS_SPACE(*p) && *p != '\r') p++;
+		return negative ? -i : i;
+	}
+
+	/* make index zero-base, and also support relative index */
+	static inline int fixIndex(int idx, int n)
+	{
+		if (idx > 0) return idx - 1;
+		if (idx == 0) return 0;
+		return n + idx;
+	}
+
+	/* parse triples: i, i/j/k, i//k, i/j */
+	static inline vertex_index parseTriple(const char*& p, const char* end, int vsize, int vnsize, int vtsize)
+	{
+		vertex_index vi;
+		vi.v_idx = fixIndex(parseIndex(p, end), vsize);
+		if (p >= end || *p != '/') return vi;
+		p++;
+
+		if (p < end && *p == '/')
+		{
+			p++;
+			vi.vn_idx = fixIndex(parseIndex(p, end), vnsize);
+			return vi;
+		}
+
+		vi.vt_idx = fixIndex(parseIndex(p, end), vtsize);
+		if (p >= end || *p != '/') return vi;
+		p++;
+		vi.vn_idx = fixIndex(parseIndex(p, end), vnsize);
+		return vi;
+	}
+
+	/* first whitespace separated word of [p, end) */
+	static inline std::string parseName(const char* p, const char* end)
+	{
+		p = skipSpace(p, end);
+		return std::string(p, skipToken(p, end));
+	}
+
+	static inline bool updateVertex(Parser& parser, bool direct, tinyobj::mesh_t& mesh, const vertex_index& i, unsigned int& index)
+	{
+		unsigned int& cached = direct ? parser.direct[i.v_idx] : parser.cache.lookup(i);
+		if (cached != vertex_cache::EMPTY)
+		{
+			index = cached;
+			return true;
+		}
+
+		if (i.v_idx < 0 || (size_t)i.v_idx * 3 + 2 >= parser.v.size()) return false;
+
+		const float* pos = &parser.v[(size_t)i.v_idx * 3];
+		mesh.positions.insert(mesh.positions.end(), pos, pos + 3);
+
+		if (i.vn_idx >= 0 && (size_t)i.vn_idx * 3 + 2 < parser.vn.size())
+		{
+			const float* n = &parser.vn[(size_t)i.vn_idx * 3];
+			mesh.normals.insert(mesh.normals.end(), n, n + 3);
+		}
+
+		if (i.vt_idx >= 0 && (size_t)i.vt_idx * 2 + 1 < parser.vt.size())
+		{
+			const float* t = &parser.vt[(size_t)i.vt_idx * 2];
+			mesh.texcoords.insert(mesh.texcoords.end(), t, t + 2);
+		}
+
+		if (parser.sources)
+		{
+			parser.sources->push_back(i.v_idx);
+			parser.sources->push_back(i.vt_idx);
+			parser.sources->push_back(i.vn_idx);
+		}
+
+		index = (unsigned int)(mesh.positions.size() / 3 - 1);
+		cached = index;
+		if (!direct) parser.cache.inserted();
+		return true;
+	}
+
+	/* equivalent of tinyobj's exportFaceGroupToShape, returns false on an empty group */
+	static bool exportFaceGroupToShape(Parser& parser, tinyobj::shape_t& shape, int material_id,
+		const std::string& name, std::string& err)
+	{
+		if (parser.face_sizes.empty()) return false;
+
+		tinyobj::mesh_t& mesh = shape.mesh;
+		bool direct = !parser.corners.empty() && tinyobj::usesMatchingIndices(parser.corners[0], &parser.corners[0],
+			parser.corners.size(), (int)(parser.v.size() / 3));
+		if (direct && parser.direct.size() < parser.v.size() / 3)
+			parser.direct.resize(parser.v.size() / 3, (unsigned int)vertex_cache::EMPTY);
+
+		const vertex_index* face = &parser.corners[0];
+		bool ok = true;
+		for (size_t f = 0; f < parser.face_sizes.size(); f++)
+		{
+			int npolys = parser.face_sizes[f];
+			if (parser.triangulate)
+			{
+				//polygon -> triangle fan conversion
+				for (int k = 2; k < npolys; k++)
+				{
+					unsigned int v0, v1, v2;
+					ok = updateVertex(parser, direct, mesh, face[0], v0)
+						&& updateVertex(parser, direct, mesh, face[k - 1], v1)
+						&& updateVertex(parser, direct, mesh, face[k], v2) && ok;
+					mesh.indices.push_back(v0);
+					mesh.indices.push_back(v1);
+					mesh.indices.push_back(v2);
+					mesh.num_vertices.push_back(3);
+					mesh.material_ids.push_back(material_id);
+				}
+			}
+			else
+			{
+				for (int k = 0; k < npolys; k++)
+				{
+					unsigned int vk;
+					ok = updateVertex(parser, direct, mesh, face[k], vk) && ok;
+					mesh.indices.push_back(vk);
+				}
+				mesh.num_vertices.push_back((unsigned char)npolys);
+				mesh.material_ids.push_back(material_id);
+			}
+			face += npolys;
+		}
+		if (!ok) err += "WARN: face refers to a vertex that does not exist.\n";
+
+		shape.name = name;
+		parser.cache.clear();
+		if (direct)
+		{
+			for (size_t k = 0; k < parser.corners.size(); k++)
+				parser.direct[parser.corners[k].v_idx] = vertex_cache::EMPTY;
+		}
+		parser.corners.clear();
+		parser.face_sizes.clear();
+		return true;
+	}
+
+	/* shared by parseObj and loadMeshAttributes, parser holds the options */
+	static bool parseBuffer(Parser& parser, std::vector<tinyobj::shape_t>& shapes,
+		std::vector<tinyobj::material_t>& materials, std::string& err,
+		const char* data, size_t size, tinyobj::MaterialReader& readMatFn)
+	{
+		shapes.clear();
+
+		//rough guess of the attribute counts so the common case never reallocates
+		parser.v.reserve(size / 16);
+		parser.vn.reserve(size / 16);
+
+		std::map<std::string, int> material_map;
+		int material = -1;
+		std::string name;
+		tinyobj::shape_t shape;
+		size_t shape_sources = 0;   //size of *parser.sources when shape was started
+
+		const char* p = data;
+		const char* end = data + size;
+		while (p < end)
+		{
+			const char* eol = findLineEnd(p, end);
+			const char* token = skipSpace(p, eol);
+			p = eol + 1;
+
+			//trim '\r' of '\r\n' line endings
+			const char* line_end = eol;
+			if (line_end > token && line_end[-1] == '\r') line_end--;
+			if (token >= line_end || token[0] == '#') continue;
+
+			size_t len = (size_t)(line_end - token);
+			char c0 = token[0];
+			char c1 = len > 1 ? token[1] : 0;
+			char c2 = len > 2 ? token[2] : 0;
+
+			//vertex
+			if (c0 == 'v' && IS_SPACE(c1))
+			{
+				token += 2;
+				float x = parseFloat(token, line_end);
+				float y = parseFloat(token, line_end);
+				float z = parseFloat(token, line_end);
+				parser.v.push_back(x);
+				parser.v.push_back(y);
+				parser.v.push_back(z);
+				continue;
+			}
+
+			//normal
+			if (c0 == 'v' && c1 == 'n' && IS_SPACE(c2))
+			{
+				token += 3;
+				float x = parseFloat(token, line_end);
+				float y = parseFloat(token, line_end);
+				float z = parseFloat(token, line_end);
+				parser.vn.push_back(x);
+				parser.vn.push_back(y);
+				parser.vn.push_back(z);
+				continue;
+			}
+
+			//texcoord
+			if (c0 == 'v' && c1 == 't' && IS_SPACE(c2))
+			{
+				token += 3;
+				float x = parseFloat(token, line_end);
+				float y = parseFloat(token, line_end);
+				parser.vt.push_back(x);
+				parser.vt.push_back(y);
+				continue;
+			}
+
+			//face
+			if (c0 == 'f' && IS_SPACE(c1))
+			{
+				token = skipSpace(token + 2, line_end);
+				int vsize  = (int)(parser.v.size() / 3);
+				int vnsize = (int)(parser.vn.size() / 3);
+				int vtsize = (int)(parser.vt.size() / 2);
+				unsigned long long h = parser.topology.face_hash;
+				int n = 0;
+				while (token < line_end)
+				{
+					vertex_index vi = parseTriple(token, line_end, vsize, vnsize, vtsize);
+					h = hashInt(hashInt(hashInt(h, vi.v_idx), vi.vt_idx), vi.vn_idx);
+					if (parser.faces) parser.corners.push_back(vi);
+					n++;
+					token = skipSpace(token, line_end);
+				}
+				parser.topology.face_hash = hashInt(h, -n);
+				parser.topology.num_faces++;
+				if (parser.faces) parser.face_sizes.push_back(n);
+				continue;
+			}
+
+			//use mtl
+			if (len > 6 && strncmp(token, "usemtl", 6) == 0 && IS_SPACE(token[6]))
+			{
+				std::string mtl = parseName(token + 7, line_end);
+				std::map<std::string, int>::const_iterator it = material_map.find(mtl);
+				int newMaterialId = it != material_map.end() ? it->second : -1;
+				if (newMaterialId != material)
+				{
+					//create per-face material
+					exportFaceGroupToShape(parser, shape, material, name, err);
+					material = newMaterialId;
+				}
+				continue;
+			}
+
+			//load mtl
+			if (len > 6 && strncmp(token, "mtllib", 6) == 0 && IS_SPACE(token[6]))
+			{
+				if (!parser.faces) continue;   //materials only matter to shapes
+				std::string err_mtl;
+				bool ok = readMatFn(parseName(token + 7, line_end), materials, material_map, err_mtl);
+				err += err_mtl;
+				if (!ok) return false;
+				continue;
+			}
+
+			//group or object name
+			if ((c0 == 'g' || c0 == 'o') && IS_SPACE(c1))
+			{
+				//flush previous face group, a shape without one is dropped
+				if (exportFaceGroupToShape(parser, shape, material, name, err))
+					shapes.push_back(shape);
+				else if (parser.sources)
+					parser.sources->resize(shape_sources);
+				shape = tinyobj::shape_t();
+				if (parser.sources) shape_sources = parser.sources->size();
+				parser.corners.clear();
+				parser.face_sizes.clear();
+				name = parseName(token + 2, line_end);
+				continue;
+			}
+
+			//ignore unknown command
+		}
+
+		if (exportFaceGroupToShape(parser, shape, material, name, err))
+			shapes.push_back(shape);
+		else if (parser.sources)
+			parser.sources->resize(shape_sources);
+
+		parser.topology.num_positions = (int)(parser.v.size() / 3);
+		parser.topology.num_texcoords = (int)(parser.vt.size() / 2);
+		parser.topology.num_normals   = (int)(parser.vn.size() / 3);
+		return true;
+	}
+
+	bool parseObj(std::vector<tinyobj::shape_t>& shapes, std::vector<tinyobj::material_t>& materials,
+		std::string& err, const char* data, size_t size, tinyobj::MaterialReader& readMatFn, bool triangulate)
+	{
+		Parser parser;
+		parser.sources = NULL;
+		parser.triangulate = triangulate;
+		parser.faces = true;
+		return parseBuffer(parser, shapes, materials, err, data, size, readMatFn);
+	}
+
+	bool loadObj(std::vector<tinyobj::shape_t>& shapes, std::vector<tinyobj::material_t>& materials,
+		std::string& err, const char* filename, const char* mtl_basepath, bool triangulate)
+	{
+		shapes.clear();
+
+		tinyobj::MaterialFileReader matFileReader(mtl_basepath ? mtl_basepath : "");
+
+		FileUtils::MappedFile file;
+		if (!FileUtils::mapFile(filename, file))
+		{
+			//an empty file cannot be mapped but is still a valid OBJ
+			long long time;
+			if (FileUtils::getModifiedTime(filename, time)) return true;
+			err += std::string("Cannot open file [") + filename + "]\n";
+			return false;
+		}
+
+		bool ret = parseObj(shapes, materials, err, file.data, file.size, matFileReader, triangulate);
+		FileUtils::unmapFile(file);
+		return ret;
+	}
+
+	/* map filename and run the parser over it, an empty file parses as nothing */
+	static bool parseFile(Parser& parser, std::vector<tinyobj::shape_t>& shapes, std::string& err, const char* filename)
+	{
+		std::vector<tinyobj::material_t> materials;
+		tinyobj::MaterialFileReader matFileReader("");
+
+		FileUtils::MappedFile file;
+		if (!FileUtils::mapFile(filename, file))
+		{
+			long long time;
+			if (FileUtils::getModifiedTime(filename, time)) return true;
+			err += std::string("Cannot open file [") + filename + "]\n";
+			return false;
+		}
+
+		bool ret = parseBuffer(parser, shapes, materials, err, file.data, file.size, matFileReader);
+		FileUtils::unmapFile(file);
+		return ret;
+	}
+
+	bool loadMesh(const char* filename, Mesh& mesh, std::string& err)
+	{
+		mesh = Mesh();
+
+		Parser parser;
+		parser.sources = &mesh.sources;
+		parser.triangulate = true;
+		parser.faces = true;
+		std::vector<tinyobj::shape_t> shapes;
+		if (!parseFile(parser, shapes, err, filename)) return false;
+		mesh.topology = parser.topology;
+
+		bool hasNormals = true;
+		bool hasTexcoords = true;
+		for (size_t i = 0; i < shapes.size(); i++)
+		{
+			const tinyobj::mesh_t& shape = shapes[i].mesh;
+			hasNormals   = hasNormals && shape.normals.size() == shape.positions.size();
+			hasTexcoords = hasTexcoords && shape.texcoords.size() / 2 == shape.positions.size() / 3;
+		}
+
+		//append the shapes one after the other, offsetting their indices
+		for (size_t i = 0; i < shapes.size(); i++)
+		{
+			const tinyobj::mesh_t& shape = shapes[i].mesh;
+			unsigned int base = (unsigned int)(mesh.positions.size() / 3);
+			mesh.positions.insert(mesh.positions.end(), shape.positions.begin(), shape.positions.end());
+			if (hasNormals)
+				mesh.normals.insert(mesh.normals.end(), shape.normals.begin(), shape.normals.end());
+			if (hasTexcoords)
+				mesh.texcoords.insert(mesh.texcoords.end(), shape.texcoords.begin(), shape.texcoords.end());
+			for (size_t j = 0; j < shape.indices.size(); j++)
+				mesh.indices.push_back(base + shape.indices[j]);
+		}
+		return true;
+	}
+
+	bool loadMeshAttributes(const char* filename, const Mesh& reference, Mesh& mesh, std::string& err)
+	{
+		mesh = Mesh();
+
+		Parser parser;
+		parser.sources = NULL;
+		parser.triangulate = true;
+		parser.faces = false;
+		std::vector<tinyobj::shape_t> shapes;
+		if (!parseFile(parser, shapes, err, filename)) return false;
+		mesh.topology = parser.topology;
+
+		const Topology& a = mesh.topology;
+		const Topology& b = reference.topology;
+		if (a != b)
+		{
+			std::ostringstream ss;
+			ss << filename << " does not have the topology of the neutral mesh: ";
+			if (a.num_positions != b.num_positions || a.num_texcoords != b.num_texcoords
+				|| a.num_normals != b.num_normals || a.num_faces != b.num_faces)
+			{
+				ss << a.num_positions << "/" << a.num_texcoords << "/" << a.num_normals << " v/vt/vn and "
+					<< a.num_faces << " faces instead of " << b.num_positions << "/" << b.num_texcoords << "/"
+					<< b.num_normals << " and " << b.num_faces;
+			}
+			else
+			{
+				ss << "same element counts but the faces use different indices";
+			}
+			err += ss.str() + "\n";
+			return false;
+		}
+
+		//gather the attributes in the vertex order of the reference
+		size_t num_vertices = reference.sources.size() / 3;
+		mesh.positions.resize(num_vertices * 3);
+		mesh.normals.resize(reference.normals.empty() ? 0 : num_vertices * 3);
+		mesh.texcoords.resize(reference.texcoords.empty() ? 0 : num_vertices * 2);
+		for (size_t k = 0; k < num_vertices; k++)
+		{
+			const int* source = &reference.sources[k * 3];
+			memcpy(&mesh.positions[k * 3], &parser.v[(size_t)source[0] * 3], sizeof(float) * 3);
+			if (!mesh.texcoords.empty())
+				memcpy(&mesh.texcoords[k * 2], &parser.vt[(size_t)source[1] * 2], sizeof(float) * 2);
+			if (!mesh.normals.empty())
+				memcpy(&mesh.normals[k * 3], &parser.vn[(size_t)source[2] * 3], sizeof(float) * 3);
+		}
+		return true;
+	}
+}
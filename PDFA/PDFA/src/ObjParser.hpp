@@ -0,0 +1,77 @@
+//
+//  ObjParser.hpp
+//  PDFA
+//
+
+#ifndef ObjParser_hpp
+#define ObjParser_hpp
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <tiny_obj_loader.h>
+
+/**
+ * ObjParser
+ * Drop-in replacement for tinyobj::LoadObj that parses a memory mapped file
+ * in place. Lines are located with SSE2 and parsed without any per-line
+ * allocation; the resulting shapes are the same as tinyobj's. Subdivision
+ * tags ('t' lines) are not supported and are skipped.
+ */
+namespace ObjParser
+{
+	/* element counts of an OBJ file and a hash of its face index stream */
+	struct Topology
+	{
+		int num_positions;
+		int num_texcoords;
+		int num_normals;
+		int num_faces;
+		unsigned long long face_hash;
+		Topology();
+		bool operator==(const Topology& other) const;
+		bool operator!=(const Topology& other) const { return !(*this == other); }
+	};
+
+	/**
+	 * All the shapes of an OBJ file merged into one indexed triangle mesh.
+	 * sources holds the (v, vt, vn) indices every vertex was built from, so
+	 * files sharing the topology can be read without their faces.
+	 */
+	struct Mesh
+	{
+		std::vector<float> positions;
+		std::vector<float> normals;         //empty unless every vertex has one
+		std::vector<float> texcoords;       //empty unless every vertex has one
+		std::vector<unsigned int> indices;
+		std::vector<int> sources;           //3 per vertex
+		Topology topology;
+	};
+
+	bool loadObj(std::vector<tinyobj::shape_t>& shapes,       // [output]
+	             std::vector<tinyobj::material_t>& materials, // [output]
+	             std::string& err,                            // [output]
+	             const char* filename, const char* mtl_basepath = NULL,
+	             bool triangulate = true);
+
+	/* parse OBJ text held in memory, data does not need to be null terminated */
+	bool parseObj(std::vector<tinyobj::shape_t>& shapes,       // [output]
+	              std::vector<tinyobj::material_t>& materials, // [output]
+	              std::string& err,                            // [output]
+	              const char* data, size_t size,
+	              tinyobj::MaterialReader& readMatFn,
+	              bool triangulate = true);
+
+	bool loadMesh(const char* filename, Mesh& mesh, std::string& err);
+
+	/**
+	 * Load a file that must have the topology of reference, such as a
+	 * blendshape target of a neutral mesh. Face lines are only fingerprinted,
+	 * and mesh receives the vertex attributes in the vertex order of reference
+	 * and no indices. Returns false with a diagnostic in err if the
+	 * topologies differ.
+	 */
+	bool loadMeshAttributes(const char* filename, const Mesh& reference, Mesh& mesh, std::string& err);
+}
+
+#endif /* ObjParser_hpp */
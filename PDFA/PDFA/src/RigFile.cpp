@@ -0,0 +1,195 @@
+//
+//  RigFile.cpp
+//  PDFA
+//
+
+#define _CRT_SECURE_NO_WARNINGS 1
+
+#include "RigFile.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <stdint.h>
+
+namespace RigFile
+{
+	static const char     rigMagic[8] = { 'P', 'D', 'F', 'A', 'R', 'I', 'G', 0 };
+	static const uint32_t rigVersion = 2;
+	static const uint64_t rigAlignment = 64;
+
+	struct Header
+	{
+		char     magic[8];
+		uint32_t version;
+		uint32_t num_vertices;
+		uint32_t num_indices;
+		uint32_t num_targets;
+		uint64_t source_hash;
+		uint64_t file_size;
+		/* byte offsets of the arrays, 0 if absent */
+		uint64_t positions;
+		uint64_t normals;
+		uint64_t texcoords;
+		uint64_t indices;
+		uint64_t bs_positions;
+		uint64_t bs_normals;
+	};
+
+	Rig::Rig() : num_vertices(0), num_indices(0), num_targets(0),
+		positions(NULL), normals(NULL), texcoords(NULL), indices(NULL),
+		bs_positions(NULL), bs_normals(NULL) {}
+
+	/* FNV-1a over the source file names, so renaming a target invalidates the rig */
+	static uint64_t hashSources(const char* const* sources, int num_sources)
+	{
+		uint64_t h = 14695981039346656037ULL;
+		for (int i = 0; i < num_sources; i++)
+		{
+			for (const char* c = sources[i]; *c; c++)
+			{
+				h ^= (unsigned char)*c;
+				h *= 1099511628211ULL;
+			}
+			h ^= 0xff;
+			h *= 1099511628211ULL;
+		}
+		return h;
+	}
+
+	static uint64_t align(uint64_t offset)
+	{
+		return (offset + rigAlignment - 1) & ~(rigAlignment - 1);
+	}
+
+	static uint64_t layout(uint64_t& offset, uint64_t size)
+	{
+		if (size == 0) return 0;
+		uint64_t start = align(offset);
+		offset = start + size;
+		return start;
+	}
+
+	/* pad from the current position pos up to offset, then write the array */
+	static bool writeAt(FILE* fp, uint64_t& pos, uint64_t offset, const void* data, uint64_t size)
+	{
+		if (size == 0) return true;
+		static const char zeros[rigAlignment] = { 0 };
+		if (pos > offset) return false;
+		uint64_t padding = offset - pos;
+		if (padding && fwrite(zeros, 1, (size_t)padding, fp) != padding) return false;
+		if (fwrite(data, 1, (size_t)size, fp) != size) return false;
+		pos = offset + size;
+		return true;
+	}
+
+	bool write(const char* filename, const Rig& rig, const char* const* sources, int num_sources)
+	{
+		uint64_t nv = (uint64_t)rig.num_vertices;
+		uint64_t nt = (uint64_t)rig.num_targets;
+
+		Header header;
+		memset(&header, 0, sizeof(header));
+		memcpy(header.magic, rigMagic, sizeof(rigMagic));
+		header.version      = rigVersion;
+		header.num_vertices = (uint32_t)rig.num_vertices;
+		header.num_indices  = (uint32_t)rig.num_indices;
+		header.num_targets  = (uint32_t)rig.num_targets;
+		header.source_hash  = hashSources(sources, num_sources);
+
+		uint64_t offset = sizeof(Header);
+		uint64_t size_texcoords = rig.texcoords ? nv * 2 * sizeof(float) : 0;
+		uint64_t size_indices   = rig.indices ? (uint64_t)rig.num_indices * sizeof(unsigned int) : 0;
+		header.positions    = layout(offset, nv * 3 * sizeof(float));
+		header.normals      = layout(offset, nv * 3 * sizeof(float));
+		header.texcoords    = layout(offset, size_texcoords);
+		header.indices      = layout(offset, size_indices);
+		header.bs_positions = layout(offset, nt * nv * 3 * sizeof(float));
+		header.bs_normals   = layout(offset, nt * nv * 3 * sizeof(float));
+		header.file_size    = offset;
+
+		FILE* fp = fopen(filename, "wb");
+		if (!fp) return false;
+
+		uint64_t pos = sizeof(Header);
+		bool ok = fwrite(&header, sizeof(header), 1, fp) == 1
+			&& writeAt(fp, pos, header.positions, rig.positions, nv * 3 * sizeof(float))
+			&& writeAt(fp, pos, header.normals, rig.normals, nv * 3 * sizeof(float))
+			&& writeAt(fp, pos, header.texcoords, rig.texcoords, size_texcoords)
+			&& writeAt(fp, pos, header.indices, rig.indices, size_indices)
+			&& writeAt(fp, pos, header.bs_positions, rig.bs_positions, nt * nv * 3 * sizeof(float))
+			&& writeAt(fp, pos, header.bs_normals, rig.bs_normals, nt * nv * 3 * sizeof(float));
+
+		ok = (fclose(fp) == 0) && ok;
+		if (!ok) remove(filename);
+		return ok;
+	}
+
+	static bool validate(const Header& header, size_t file_size)
+	{
+		if (memcmp(header.magic, rigMagic, sizeof(rigMagic)) != 0) return false;
+		if (header.version != rigVersion) return false;
+		if (header.file_size != file_size) return false;
+
+		uint64_t nv = header.num_vertices;
+		uint64_t nt = header.num_targets;
+		const uint64_t offsets[] = { header.positions, header.normals, header.texcoords,
+			header.indices, header.bs_positions, header.bs_normals };
+		const uint64_t sizes[] = { nv * 3 * sizeof(float), nv * 3 * sizeof(float), nv * 2 * sizeof(float),
+			(uint64_t)header.num_indices * sizeof(unsigned int), nt * nv * 3 * sizeof(float), nt * nv * 3 * sizeof(float) };
+		for (int i = 0; i < 6; i++)
+		{
+			if (offsets[i] == 0) continue;
+			if (offsets[i] % rigAlignment != 0) return false;
+			if (offsets[i] + sizes[i] > file_size) return false;
+		}
+		return header.positions != 0 && header.normals != 0;
+	}
+
+	bool open(const char* filename, Rig& rig, FileUtils::MappedFile& file)
+	{
+		if (!FileUtils::mapFile(filename, file)) return false;
+
+		if (file.size < sizeof(Header) || !validate(*(const Header*)file.data, file.size))
+		{
+			FileUtils::unmapFile(file);
+			return false;
+		}
+
+		const Header& header = *(const Header*)file.data;
+		rig = Rig();
+		rig.num_vertices = (int)header.num_vertices;
+		rig.num_indices  = (int)header.num_indices;
+		rig.num_targets  = (int)header.num_targets;
+		rig.positions    = (const float*)(file.data + header.positions);
+		rig.normals      = (const float*)(file.data + header.normals);
+		if (header.texcoords)    rig.texcoords    = (const float*)(file.data + header.texcoords);
+		if (header.indices)      rig.indices      = (const unsigned int*)(file.data + header.indices);
+		if (header.bs_positions) rig.bs_positions = (const float*)(file.data + header.bs_positions);
+		if (header.bs_normals)   rig.bs_normals   = (const float*)(file.data + header.bs_normals);
+		return true;
+	}
+
+	bool isUpToDate(const char* filename, const char* const* sources, int num_sources)
+	{
+		long long rigTime;
+		if (!FileUtils::getModifiedTime(filename, rigTime)) return false;
+		for (int i = 0; i < num_sources; i++)
+		{
+			//whole seconds only: a source saved in the second the rig was written may be newer
+			long long sourceTime;
+			if (FileUtils::getModifiedTime(sources[i], sourceTime) && sourceTime >= rigTime)
+				return false;
+		}
+
+		FILE* fp = fopen(filename, "rb");
+		if (!fp) return false;
+		Header header;
+		bool ok = fread(&header, sizeof(header), 1, fp) == 1;
+		fclose(fp);
+
+		return ok
+			&& memcmp(header.magic, rigMagic, sizeof(rigMagic)) == 0
+			&& header.version == rigVersion
+			&& header.source_hash == hashSources(sources, num_sources);
+	}
+}
@@ -0,0 +1,43 @@
+//
+//  RigFile.hpp
+//  PDFA
+//
+
+#ifndef RigFile_hpp
+#define RigFile_hpp
+
+#include "FileUtils.hpp"
+
+/**
+ * RigFile
+ * Precompiled binary blendshape rig. The neutral mesh, its index buffer and
+ * the per-target deltas are stored as 64-byte aligned arrays so that a mapped
+ * file can be handed directly to the VBO uploads without any parsing.
+ */
+namespace RigFile
+{
+	struct Rig
+	{
+		int num_vertices;               // vertices in every vertex stream
+		int num_indices;                // 0 for a non-indexed triangle list
+		int num_targets;
+		const float* positions;         // num_vertices * 3
+		const float* normals;           // num_vertices * 3
+		const float* texcoords;         // num_vertices * 2, NULL if the mesh has none
+		const unsigned int* indices;    // num_indices, NULL if non-indexed
+		const float* bs_positions;      // num_targets blocks of num_vertices * 3
+		const float* bs_normals;        // num_targets blocks of num_vertices * 3
+		Rig();
+	};
+
+	/* write the rig, tagging it with the list of source files it was compiled from */
+	bool write(const char* filename, const Rig& rig, const char* const* sources, int num_sources);
+
+	/* map a rig file and point the arrays of rig into it */
+	bool open(const char* filename, Rig& rig, FileUtils::MappedFile& file);
+
+	/* true if the rig was compiled from these sources and is newer than all of them */
+	bool isUpToDate(const char* filename, const char* const* sources, int num_sources);
+}
+
+#endif /* RigFile_hpp */
@@ -0,0 +1,269 @@
+//
+//  SimdKernels.cpp
+//  PDFA
+//
+
+#include "SimdKernels.hpp"
+
+#include <cmath>
+#include <cstring>
+#include <mutex>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define SIMDKERNELS_X86 1
+#include <immintrin.h>
+#endif
+
+/**
+ * Every instruction set is compiled with its own target, whatever the
+ * compiler flags: GCC and Clang need it to emit the instructions, MSVC
+ * emits any intrinsic as is. AVX-512 intrinsics need VS2017 or later.
+ */
+#define SIMDKERNELS_STRING(x) #x
+#if defined(__clang__)
+#define SIMDKERNELS_TARGET(isa) \
+	_Pragma(SIMDKERNELS_STRING(clang attribute push(__attribute__((target(isa))), apply_to = function)))
+#define SIMDKERNELS_TARGET_END _Pragma("clang attribute pop")
+#elif defined(__GNUC__)
+#define SIMDKERNELS_TARGET(isa) _Pragma("GCC push_options") _Pragma(SIMDKERNELS_STRING(GCC target(isa)))
+#define SIMDKERNELS_TARGET_END _Pragma("GCC pop_options")
+#else
+#define SIMDKERNELS_TARGET(isa)
+#define SIMDKERNELS_TARGET_END
+#endif
+#if defined(SIMDKERNELS_X86) && (!defined(_MSC_VER) || _MSC_VER >= 1910)
+#define SIMDKERNELS_AVX512 1
+#endif
+
+namespace SimdKernels
+{
+	static inline unsigned int floatBits(float f)
+	{
+		unsigned int u;
+		memcpy(&u, &f, sizeof(u));
+		return u;
+	}
+
+	static inline float bitsFloat(unsigned int u)
+	{
+		float f;
+		memcpy(&f, &u, sizeof(f));
+		return f;
+	}
+
+	half floatToHalf(float f)
+	{
+		unsigned int u = floatBits(f);
+		unsigned int sign = (u >> 16) & 0x8000;
+		u &= 0x7fffffff;
+		unsigned int h;
+		if (u >= 0x47800000)
+		{
+			//infinite or nan, and everything that rounds past 65504
+			h = u > 0x7f800000 ? 0x7e00 : 0x7c00;
+		}
+		else if (u < 0x38800000)
+		{
+			//subnormal or zero, the addition aligns and rounds the mantissa
+			h = floatBits(bitsFloat(u) + 0.5f) - 0x3f000000;
+		}
+		else
+		{
+			//rebias the exponent and round the 13 dropped bits to nearest even
+			u += ((unsigned int)(15 - 127) << 23) + 0xfff + ((u >> 13) & 1);
+			h = u >> 13;
+		}
+		return (half)(h | sign);
+	}
+
+	float halfToFloat(half h)
+	{
+		//scaling by 2^112 rebiases the exponent and normalizes the subnormals
+		unsigned int expmant = h & 0x7fff;
+		float f = bitsFloat(expmant << 13) * bitsFloat((254 - 15) << 23);
+		unsigned int u = floatBits(f) | ((unsigned int)(h & 0x8000) << 16);
+		if (expmant > 0x7bff) u |= 255 << 23;
+		return bitsFloat(u);
+	}
+
+	static inline float toFloat(float f) { return f; }
+	static inline float toFloat(half h) { return halfToFloat(h); }
+
+	namespace Scalar
+	{
+		struct Ops
+		{
+			typedef float V;
+			static const int width = 1;
+			static inline V load(const float* p) { return *p; }
+			static inline V load(const half* p) { return halfToFloat(*p); }
+			static inline void storeHalf(half* p, V v) { *p = floatToHalf(v); }
+			static inline V loadu(const float* p) { return *p; }
+			static inline void store(float* p, V v) { *p = v; }
+			static inline void storeu(float* p, V v) { *p = v; }
+			static inline V set1(float f) { return f; }
+			static inline V sub(V a, V b) { return a - b; }
+			static inline V madd(V a, V b, V c) { return a * b + c; }
+			static inline V inverseSqrt(V a) { return 1.0f / std::sqrt(a); }
+		};
+#include "SimdKernels.inl"
+	}
+
+#if defined(SIMDKERNELS_X86)
+SIMDKERNELS_TARGET("sse2")
+	namespace Sse2
+	{
+		struct Ops
+		{
+			typedef __m128 V;
+			static const int width = 4;
+			static inline V load(const float* p) { return _mm_load_ps(p); }
+			static inline V load(const half* p)
+			{
+				return fromHalf(_mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i*)p), _mm_setzero_si128()));
+			}
+			static inline void storeHalf(half* p, V v)
+			{
+				float f[width];
+				_mm_storeu_ps(f, v);
+				for (int k = 0; k < width; k++) p[k] = floatToHalf(f[k]);
+			}
+			static inline V loadu(const float* p) { return _mm_loadu_ps(p); }
+			static inline void store(float* p, V v) { _mm_store_ps(p, v); }
+			static inline void storeu(float* p, V v) { _mm_storeu_ps(p, v); }
+			static inline V set1(float f) { return _mm_set1_ps(f); }
+			static inline V sub(V a, V b) { return _mm_sub_ps(a, b); }
+			static inline V madd(V a, V b, V c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+			static inline V inverseSqrt(V a) { return _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(a)); }
+
+			/* halfToFloat on 4 halves zero extended to 32 bits, without F16C */
+			static inline V fromHalf(__m128i h)
+			{
+				__m128i expmant = _mm_and_si128(h, _mm_set1_epi32(0x7fff));
+				__m128i sign = _mm_slli_epi32(_mm_xor_si128(h, expmant), 16);
+				__m128 scaled = _mm_mul_ps(_mm_castsi128_ps(_mm_slli_epi32(expmant, 13)),
+					_mm_castsi128_ps(_mm_set1_epi32((254 - 15) << 23)));
+				__m128i infnan = _mm_and_si128(_mm_cmpgt_epi32(expmant, _mm_set1_epi32(0x7bff)), _mm_set1_epi32(255 << 23));
+				return _mm_or_ps(scaled, _mm_castsi128_ps(_mm_or_si128(sign, infnan)));
+			}
+		};
+#include "SimdKernels.inl"
+	}
+SIMDKERNELS_TARGET_END
+
+SIMDKERNELS_TARGET("avx")
+	namespace Avx
+	{
+		struct Ops
+		{
+			typedef __m256 V;
+			static const int width = 8;
+			static inline V load(const float* p) { return _mm256_load_ps(p); }
+			static inline V load(const half* p)
+			{
+				__m128i h = _mm_loadu_si128((const __m128i*)p);
+				__m128 lo = Sse2::Ops::fromHalf(_mm_unpacklo_epi16(h, _mm_setzero_si128()));
+				__m128 hi = Sse2::Ops::fromHalf(_mm_unpackhi_epi16(h, _mm_setzero_si128()));
+				return _mm256_insertf128_ps(_mm256_castps128_ps256(lo), hi, 1);
+			}
+			static inline void storeHalf(half* p, V v)
+			{
+				float f[width];
+				_mm256_storeu_ps(f, v);
+				for (int k = 0; k < width; k++) p[k] = floatToHalf(f[k]);
+			}
+			static inline V loadu(const float* p) { return _mm256_loadu_ps(p); }
+			static inline void store(float* p, V v) { _mm256_store_ps(p, v); }
+			static inline void storeu(float* p, V v) { _mm256_storeu_ps(p, v); }
+			static inline V set1(float f) { return _mm256_set1_ps(f); }
+			static inline V sub(V a, V b) { return _mm256_sub_ps(a, b); }
+			static inline V madd(V a, V b, V c) { return _mm256_add_ps(_mm256_mul_ps(a, b), c); }
+			static inline V inverseSqrt(V a) { return _mm256_div_ps(_mm256_set1_ps(1.0f), _mm256_sqrt_ps(a)); }
+		};
+#include "SimdKernels.inl"
+	}
+SIMDKERNELS_TARGET_END
+
+SIMDKERNELS_TARGET("avx2,fma,f16c")
+	namespace Avx2
+	{
+		struct Ops
+		{
+			typedef __m256 V;
+			static const int width = 8;
+			static inline V load(const float* p) { return _mm256_load_ps(p); }
+			static inline V load(const half* p) { return _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)p)); }
+			static inline void storeHalf(half* p, V v)
+			{
+				_mm_storeu_si128((__m128i*)p, _mm256_cvtps_ph(v, _MM_FROUND_TO_NEAREST_INT));
+			}
+			static inline V loadu(const float* p) { return _mm256_loadu_ps(p); }
+			static inline void store(float* p, V v) { _mm256_store_ps(p, v); }
+			static inline void storeu(float* p, V v) { _mm256_storeu_ps(p, v); }
+			static inline V set1(float f) { return _mm256_set1_ps(f); }
+			static inline V sub(V a, V b) { return _mm256_sub_ps(a, b); }
+			static inline V madd(V a, V b, V c) { return _mm256_fmadd_ps(a, b, c); }
+			static inline V inverseSqrt(V a) { return _mm256_div_ps(_mm256_set1_ps(1.0f), _mm256_sqrt_ps(a)); }
+		};
+#include "SimdKernels.inl"
+	}
+SIMDKERNELS_TARGET_END
+#endif
+
+#if defined(SIMDKERNELS_AVX512)
+SIMDKERNELS_TARGET("avx512f")
+	namespace Avx512
+	{
+		struct Ops
+		{
+			typedef __m512 V;
+			static const int width = 16;
+			static inline V load(const float* p) { return _mm512_load_ps(p); }
+			static inline V load(const half* p) { return _mm512_cvtph_ps(_mm256_loadu_si256((const __m256i*)p)); }
+			static inline void storeHalf(half* p, V v)
+			{
+				_mm256_storeu_si256((__m256i*)p, _mm512_cvtps_ph(v, _MM_FROUND_TO_NEAREST_INT));
+			}
+			static inline V loadu(const float* p) { return _mm512_loadu_ps(p); }
+			static inline void store(float* p, V v) { _mm512_store_ps(p, v); }
+			static inline void storeu(float* p, V v) { _mm512_storeu_ps(p, v); }
+			static inline V set1(float f) { return _mm512_set1_ps(f); }
+			static inline V sub(V a, V b) { return _mm512_sub_ps(a, b); }
+			static inline V madd(V a, V b, V c) { return _mm512_fmadd_ps(a, b, c); }
+			static inline V inverseSqrt(V a) { return _mm512_div_ps(_mm512_set1_ps(1.0f), _mm512_sqrt_ps(a)); }
+		};
+#include "SimdKernels.inl"
+	}
+SIMDKERNELS_TARGET_END
+#endif
+
+	static Table tables[CpuFeatures::AVX512 + 1];
+	static std::once_flag tablesOnce;
+
+	static void fillTables()
+	{
+		//levels that were not compiled fall back to the one below
+		Scalar::fill(tables[CpuFeatures::SCALAR], CpuFeatures::SCALAR);
+		for (int i = CpuFeatures::SSE2; i <= CpuFeatures::AVX512; i++) tables[i] = tables[i - 1];
+#if defined(SIMDKERNELS_X86)
+		Sse2::fill(tables[CpuFeatures::SSE2], CpuFeatures::SSE2);
+		Avx::fill(tables[CpuFeatures::AVX], CpuFeatures::AVX);
+		Avx2::fill(tables[CpuFeatures::AVX2], CpuFeatures::AVX2);
+		tables[CpuFeatures::AVX512] = tables[CpuFeatures::AVX2];
+#endif
+#if defined(SIMDKERNELS_AVX512)
+		Avx512::fill(tables[CpuFeatures::AVX512], CpuFeatures::AVX512);
+#endif
+	}
+
+	const Table& get(CpuFeatures::Level level)
+	{
+		std::call_once(tablesOnce, fillTables);
+		return tables[level];
+	}
+
+	const Table& get()
+	{
+		return get(CpuFeatures::selected());
+	}
+}
@@ -0,0 +1,83 @@
+//
+//  SimdKernels.hpp
+//  PDFA
+//
+
+#ifndef SimdKernels_hpp
+#define SimdKernels_hpp
+
+#include "CpuFeatures.hpp"
+
+#include <cstddef>
+
+/**
+ * SimdKernels
+ * The inner loops of BlendEngine, MeshNormals and the rig compiler, built
+ * for every instruction set of CpuFeatures in the same binary. get() returns
+ * the ones of CpuFeatures::selected(). The kernels are written once in
+ * SimdKernels.inl against a small set of vector operations.
+ */
+namespace SimdKernels
+{
+	/* IEEE 754 half precision floats, as stored by F16C and GL_HALF_FLOAT */
+	typedef unsigned short half;
+
+	/* round to nearest even, too large values become infinite */
+	half floatToHalf(float f);
+	float halfToFloat(half h);
+
+	/* the kernel types for deltas of type T, float or half */
+	template <typename T>
+	struct Kernels
+	{
+		/**
+		 * out[i] = base[i] + sum of weights[k] * deltas[k][offset + i] for count
+		 * floats, count a multiple of 16 and every array 64-byte aligned. base
+		 * can be out to add to it.
+		 */
+		typedef void (*BlendChunk)(const float* base, const T* const* deltas, const float* weights, int num_active,
+			size_t offset, float* out, int count);
+
+		/**
+		 * Blend frames of a mesh of size floats with num_targets deltas of size
+		 * elements, one after the other:
+		 * outs[f][i] = base[i] + sum of weights[f * num_targets + t] * delta_t[i]
+		 * for the floats [first, last), a multiple of 32.
+		 */
+		typedef void (*BlendFrames)(const float* base, const T* deltas, size_t size, int num_targets,
+			const float* weights, float* const* outs, int first, int last);
+	};
+
+	typedef Kernels<float>::BlendChunk BlendChunk;
+	typedef Kernels<float>::BlendFrames BlendFrames;
+	typedef Kernels<half>::BlendChunk BlendChunkHalf;
+	typedef Kernels<half>::BlendFrames BlendFramesHalf;
+
+	/* the unrolled blendChunk kernels go up to this many targets */
+	static const int maxUnrolled = 8;
+
+	/* number of frames blended together by blendFrames */
+	static const int frameGroup = 2;
+
+	struct Table
+	{
+		CpuFeatures::Level level;
+		BlendChunk blendChunk[maxUnrolled + 1];         //by number of targets
+		BlendChunk blendChunkGeneric;                   //any number of targets
+		BlendFrames blendFrames[frameGroup + 1];        //by number of frames, 1 or frameGroup
+		BlendChunkHalf blendChunkHalf[maxUnrolled + 1]; //the same with half deltas, converted on the fly
+		BlendChunkHalf blendChunkGenericHalf;
+		BlendFramesHalf blendFramesHalf[frameGroup + 1];
+		void (*normalize)(float* normals, int count);                               //xyz vectors, zero ones are kept
+		void (*subtract)(const float* a, const float* b, float* out, size_t count); //out = a - b
+		void (*toHalf)(const float* data, size_t count, half* out);
+		void (*fromHalf)(const half* data, size_t count, float* out);
+	};
+
+	const Table& get();
+
+	/* the kernels of a level, which must be supported */
+	const Table& get(CpuFeatures::Level level);
+}
+
+#endif /* SimdKernels_hpp */
@@ -0,0 +1,198 @@
+//
+//  SimdKernels.inl
+//  PDFA
+//
+//  Included by SimdKernels.cpp once per instruction set, in a namespace
+//  that defines the vector operations Ops and compiled for that set.
+//
+
+	/* adds the N deltas at i to o, unrolled so the weights stay in registers */
+	template <int N, typename T>
+	struct Accumulate
+	{
+		static inline Ops::V run(Ops::V o, const Ops::V* w, const T* const* d, size_t i)
+		{
+			return Ops::madd(w[N - 1], Ops::load(d[N - 1] + i), Accumulate<N - 1, T>::run(o, w, d, i));
+		}
+	};
+
+	template <typename T>
+	struct Accumulate<0, T>
+	{
+		static inline Ops::V run(Ops::V o, const Ops::V*, const T* const*, size_t) { return o; }
+	};
+
+	/* out is read and written once for all N targets, T is float or half */
+	template <int N, typename T>
+	static void blendChunkUnrolled(const float* base, const T* const* deltas, const float* weights, int,
+		size_t offset, float* out, int count)
+	{
+		const T* d[N > 0 ? N : 1];
+		Ops::V w[N > 0 ? N : 1];
+		for (int k = 0; k < N; k++)
+		{
+			d[k] = deltas[k] + offset;
+			w[k] = Ops::set1(weights[k]);
+		}
+		for (int i = 0; i < count; i += Ops::width)
+			Ops::store(out + i, Accumulate<N, T>::run(Ops::load(base + i), w, d, i));
+	}
+
+	/* two targets per pass over out */
+	template <typename T>
+	static void blendChunkGeneric(const float* base, const T* const* deltas, const float* weights, int num_active,
+		size_t offset, float* out, int count)
+	{
+		if (base != out) memcpy(out, base, sizeof(float) * count);
+		int k = 0;
+		for (; k + 1 < num_active; k += 2)
+		{
+			const T* d0 = deltas[k] + offset;
+			const T* d1 = deltas[k + 1] + offset;
+			Ops::V w0 = Ops::set1(weights[k]);
+			Ops::V w1 = Ops::set1(weights[k + 1]);
+			for (int i = 0; i < count; i += Ops::width)
+			{
+				Ops::V o = Ops::madd(w0, Ops::load(d0 + i), Ops::load(out + i));
+				Ops::store(out + i, Ops::madd(w1, Ops::load(d1 + i), o));
+			}
+		}
+		for (; k < num_active; k++)
+		{
+			const T* d = deltas[k] + offset;
+			Ops::V w = Ops::set1(weights[k]);
+			for (int i = 0; i < count; i += Ops::width)
+				Ops::store(out + i, Ops::madd(w, Ops::load(d + i), Ops::load(out + i)));
+		}
+	}
+
+	/* each delta vector is loaded once and used for the F frames */
+	template <int F, typename T>
+	static void blendFrames(const float* base, const T* deltas, size_t size, int num_targets, const float* weights,
+		float* const* outs, int first, int last)
+	{
+		int K = num_targets;
+		if (Ops::width == 1)
+		{
+			//without vectors the loads are not worth sharing, go through the targets one after the other
+			for (int f = 0; f < F; f++)
+			{
+				memcpy(outs[f] + first, base + first, sizeof(float) * (last - first));
+				for (int t = 0; t < K; t++)
+				{
+					const T* d = deltas + size * t;
+					float w = weights[f * K + t];
+					for (int i = first; i < last; i++) outs[f][i] += w * toFloat(d[i]);
+				}
+			}
+			return;
+		}
+		for (int i = first; i < last; i += 2 * Ops::width)
+		{
+			Ops::V acc[F][2];
+			for (int f = 0; f < F; f++)
+			{
+				acc[f][0] = Ops::load(base + i);
+				acc[f][1] = Ops::load(base + i + Ops::width);
+			}
+			const T* d = deltas + i;
+			for (int t = 0; t < K; t++, d += size)
+			{
+				Ops::V d0 = Ops::load(d);
+				Ops::V d1 = Ops::load(d + Ops::width);
+				for (int f = 0; f < F; f++)
+				{
+					Ops::V w = Ops::set1(weights[f * K + t]);
+					acc[f][0] = Ops::madd(w, d0, acc[f][0]);
+					acc[f][1] = Ops::madd(w, d1, acc[f][1]);
+				}
+			}
+			for (int f = 0; f < F; f++)
+			{
+				Ops::store(outs[f] + i, acc[f][0]);
+				Ops::store(outs[f] + i + Ops::width, acc[f][1]);
+			}
+		}
+	}
+
+	/* the square roots and divisions of width normals at a time */
+	static void normalize(float* normals, int count)
+	{
+		float squared[Ops::width];
+		float scale[Ops::width];
+		int i = 0;
+		for (; i + Ops::width <= count; i += Ops::width)
+		{
+			float* p = normals + (size_t)i * 3;
+			for (int k = 0; k < Ops::width; k++)
+			{
+				const float* n = p + k * 3;
+				float s = n[0] * n[0] + n[1] * n[1] + n[2] * n[2];
+				squared[k] = s > 0.0f ? s : 1.0f;
+			}
+			Ops::storeu(scale, Ops::inverseSqrt(Ops::loadu(squared)));
+			for (int k = 0; k < Ops::width; k++)
+			{
+				p[k * 3] *= scale[k]; p[k * 3 + 1] *= scale[k]; p[k * 3 + 2] *= scale[k];
+			}
+		}
+		for (; i < count; i++)
+		{
+			float* p = normals + (size_t)i * 3;
+			float length = std::sqrt(p[0] * p[0] + p[1] * p[1] + p[2] * p[2]);
+			if (length == 0.0f) continue;
+			p[0] /= length; p[1] /= length; p[2] /= length;
+		}
+	}
+
+	static void subtract(const float* a, const float* b, float* out, size_t count)
+	{
+		size_t i = 0;
+		for (; i + Ops::width <= count; i += Ops::width)
+			Ops::storeu(out + i, Ops::sub(Ops::loadu(a + i), Ops::loadu(b + i)));
+		for (; i < count; i++) out[i] = a[i] - b[i];
+	}
+
+	static void toHalf(const float* data, size_t count, half* out)
+	{
+		size_t i = 0;
+		for (; i + Ops::width <= count; i += Ops::width) Ops::storeHalf(out + i, Ops::loadu(data + i));
+		for (; i < count; i++) out[i] = floatToHalf(data[i]);
+	}
+
+	static void fromHalf(const half* data, size_t count, float* out)
+	{
+		size_t i = 0;
+		for (; i + Ops::width <= count; i += Ops::width) Ops::storeu(out + i, Ops::load(data + i));
+		for (; i < count; i++) out[i] = halfToFloat(data[i]);
+	}
+
+	template <typename T>
+	static void fillBlend(typename Kernels<T>::BlendChunk* chunk, typename Kernels<T>::BlendChunk& generic,
+		typename Kernels<T>::BlendFrames* frames)
+	{
+		chunk[0] = blendChunkUnrolled<0, T>;
+		chunk[1] = blendChunkUnrolled<1, T>;
+		chunk[2] = blendChunkUnrolled<2, T>;
+		chunk[3] = blendChunkUnrolled<3, T>;
+		chunk[4] = blendChunkUnrolled<4, T>;
+		chunk[5] = blendChunkUnrolled<5, T>;
+		chunk[6] = blendChunkUnrolled<6, T>;
+		chunk[7] = blendChunkUnrolled<7, T>;
+		chunk[8] = blendChunkUnrolled<8, T>;
+		generic = blendChunkGeneric<T>;
+		frames[0] = NULL;
+		frames[1] = blendFrames<1, T>;
+		frames[2] = blendFrames<frameGroup, T>;
+	}
+
+	static void fill(Table& table, CpuFeatures::Level level)
+	{
+		table.level = level;
+		fillBlend<float>(table.blendChunk, table.blendChunkGeneric, table.blendFrames);
+		fillBlend<half>(table.blendChunkHalf, table.blendChunkGenericHalf, table.blendFramesHalf);
+		table.normalize = normalize;
+		table.subtract = subtract;
+		table.toHalf = toHalf;
+		table.fromHalf = fromHalf;
+	}
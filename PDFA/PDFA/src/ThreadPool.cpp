@@ -0,0 +1,200 @@
+//
+//  ThreadPool.cpp
+//  PDFA
+//
+
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifdef _MSC_VER
+#define THREADPOOL_TLS __declspec(thread)
+#else
+#define THREADPOOL_TLS __thread
+#endif
+
+namespace ThreadPool
+{
+	struct Task
+	{
+		std::function<void()> fn;
+		TaskGroup* group;
+	};
+
+	struct Queue
+	{
+		std::mutex mutex;
+		std::deque<Task> tasks;
+	};
+
+	/* queue of the current thread, 0 (the shared queue) outside the pool */
+	static THREADPOOL_TLS int queueIndex = 0;
+
+	struct Pool
+	{
+		std::vector<Queue*> queues;     //the shared queue, then one per worker
+		std::vector<std::thread> workers;
+		std::atomic<int> queued;        //tasks in all the queues
+		std::mutex sleep;               //held to check for work or completion before waiting
+		std::condition_variable work;   //signalled when a task is queued
+		std::condition_variable done;   //signalled when a group runs out of pending tasks
+
+		Pool() : queued(0)
+		{
+			int n = std::max((int)std::thread::hardware_concurrency() - 1, 1);
+			for (int i = 0; i <= n; i++) queues.push_back(new Queue());
+			for (int i = 1; i <= n; i++)
+				workers.push_back(std::thread(&Pool::workerLoop, this, i));
+		}
+
+		void push(const Task& task)
+		{
+			Queue& q = *queues[queueIndex];
+			{
+				std::lock_guard<std::mutex> lock(q.mutex);
+				q.tasks.push_back(task);
+			}
+			queued++;
+			std::lock_guard<std::mutex> lock(sleep);
+			work.notify_one();
+		}
+
+		/**
+		 * Take a task of group, or of any group if NULL: the newest of our own
+		 * queue, else the oldest one found in the other queues.
+		 */
+		bool pop(TaskGroup* group, Task& task)
+		{
+			if (queued == 0) return false;
+			int n = (int)queues.size();
+			for (int k = 0; k < n; k++)
+			{
+				int i = (queueIndex + k) % n;
+				Queue& q = *queues[i];
+				std::lock_guard<std::mutex> lock(q.mutex);
+				if (q.tasks.empty()) continue;
+				if (group == NULL)
+				{
+					if (k == 0)
+					{
+						task = q.tasks.back();
+						q.tasks.pop_back();
+					}
+					else
+					{
+						task = q.tasks.front();
+						q.tasks.pop_front();
+					}
+				}
+				else
+				{
+					std::deque<Task>::iterator it = q.tasks.begin();
+					while (it != q.tasks.end() && it->group != group) ++it;
+					if (it == q.tasks.end()) continue;
+					task = *it;
+					q.tasks.erase(it);
+				}
+				queued--;
+				return true;
+			}
+			return false;
+		}
+
+		void workerLoop(int index)
+		{
+			queueIndex = index;
+			for (;;)
+			{
+				Task task;
+				if (pop(NULL, task))
+				{
+					execute(task);
+					continue;
+				}
+				std::unique_lock<std::mutex> lock(sleep);
+				while (queued == 0) work.wait(lock);
+			}
+		}
+
+		void execute(Task& task)
+		{
+			task.fn();
+			if (--task.group->pending == 0)
+			{
+				std::lock_guard<std::mutex> lock(sleep);
+				done.notify_all();
+			}
+		}
+	};
+
+	/* the pool lives until the process exits, its threads are never joined */
+	static Pool* pool = NULL;
+	static std::once_flag poolOnce;
+
+	static Pool& getPool()
+	{
+		std::call_once(poolOnce, []() { pool = new Pool(); });
+		return *pool;
+	}
+
+	int numThreads()
+	{
+		return (int)getPool().workers.size() + 1;
+	}
+
+	TaskGroup::TaskGroup() : pending(0) {}
+
+	TaskGroup::~TaskGroup()
+	{
+		wait();
+	}
+
+	void TaskGroup::run(const std::function<void()>& fn)
+	{
+		Pool& p = getPool();
+		Task task = { fn, this };
+		pending++;
+		p.push(task);
+	}
+
+	void TaskGroup::wait()
+	{
+		Pool& p = getPool();
+		while (pending > 0)
+		{
+			//help with our own tasks only, others may take much longer
+			Task task;
+			if (p.pop(this, task))
+			{
+				p.execute(task);
+				continue;
+			}
+			std::unique_lock<std::mutex> lock(p.sleep);
+			if (pending > 0) p.done.wait(lock);
+		}
+	}
+
+	void parallelFor(int begin, int end, int grain, const std::function<void(int, int)>& body)
+	{
+		if (end <= begin) return;
+		grain = std::max(grain, 1);
+		if (end - begin <= grain)
+		{
+			body(begin, end);
+			return;
+		}
+
+		TaskGroup group;
+		for (int first = begin; first < end; first += grain)
+		{
+			int last = std::min(first + grain, end);
+			group.run([&body, first, last]() { body(first, last); });
+		}
+		group.wait();
+	}
+}
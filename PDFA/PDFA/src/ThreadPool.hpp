@@ -0,0 +1,47 @@
+//
+//  ThreadPool.hpp
+//  PDFA
+//
+
+#ifndef ThreadPool_hpp
+#define ThreadPool_hpp
+
+#include <atomic>
+#include <functional>
+
+/**
+ * ThreadPool
+ * A process wide pool of worker threads, created on first use. Every worker
+ * has its own task queue: it runs the tasks it queued itself newest first,
+ * and when it runs out it steals the oldest task of another queue. Threads
+ * outside the pool queue their tasks in a shared queue.
+ */
+namespace ThreadPool
+{
+	/* number of threads taking part in parallel work, including the caller */
+	int numThreads();
+
+	/**
+	 * A set of tasks that can be waited on together. The waiting thread
+	 * helps by executing the queued tasks of its own group.
+	 */
+	class TaskGroup
+	{
+	public:
+		TaskGroup();
+		~TaskGroup();
+		void run(const std::function<void()>& task);
+		void wait();
+
+	private:
+		TaskGroup(const TaskGroup&);
+		TaskGroup& operator=(const TaskGroup&);
+		friend struct Pool;
+		std::atomic<int> pending;
+	};
+
+	/* call body(first, last) on consecutive sub-ranges of [begin, end) of at most grain items */
+	void parallelFor(int begin, int end, int grain, const std::function<void(int, int)>& body);
+}
+
+#endif /* ThreadPool_hpp */
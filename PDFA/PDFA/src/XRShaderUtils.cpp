@@ -27,6 +27,7 @@
 
 #include <GL/glew.h>
 #include <cstdio>
+#include <cstring>
 
 #ifdef _WIN32
 #include <Windows.h>
@@ -36,38 +37,50 @@
 namespace XRShaderUtils
 {
 	GLuint loadShader(const char * filename, GLenum shader_type, bool check_errors)
+	{
+		return loadShader(&filename, 1, shader_type, check_errors);
+	}
+
+	GLuint loadShader(const char * const * filenames, int file_count, GLenum shader_type, bool check_errors)
 	{
 		GLuint result = 0;
 		FILE * fp;
 		size_t filesize;
-		char * data;
+		char ** data;
+		int i;
 
-		fp = fopen(filename, "rb");
+		data = new char *[file_count];
 
-		if (!fp)
-			return 0;
+		for (i = 0; i < file_count; i++)
+		{
+			data[i] = NULL;
+		}
 
-		fseek(fp, 0, SEEK_END);
-		filesize = ftell(fp);
-		fseek(fp, 0, SEEK_SET);
+		for (i = 0; i < file_count; i++)
+		{
+			fp = fopen(filenames[i], "rb");
 
-		data = new char[filesize + 1];
+			if (!fp)
+				goto fail_data_alloc;
 
-		if (!data)
-			goto fail_data_alloc;
+			fseek(fp, 0, SEEK_END);
+			filesize = ftell(fp);
+			fseek(fp, 0, SEEK_SET);
 
-		fread(data, 1, filesize, fp);
-		data[filesize] = 0;
-		fclose(fp);
+			data[i] = new char[filesize + 1];
+
+			fread(data[i], 1, filesize, fp);
+			data[i][filesize] = 0;
+			fclose(fp);
+		}
 
 		result = glCreateShader(shader_type);
 
 		if (!result)
 			goto fail_shader_alloc;
 
-		glShaderSource(result, 1, &data, NULL);
-
-		delete[] data;
+		//the sources are compiled as one, only the first one has the #version line
+		glShaderSource(result, file_count, data, NULL);
 
 		glCompileShader(result);
 
@@ -80,6 +93,7 @@ namespace XRShaderUtils
 			{
 				char buffer[4096];
 				glGetShaderInfoLog(result, 4096, NULL, buffer);
+				const char * filename = filenames[file_count - 1];
 #ifdef _WIN32
 				OutputDebugStringA(filename);
 				OutputDebugStringA(":");
@@ -92,13 +106,21 @@ namespace XRShaderUtils
 			}
 		}
 
-		return result;
+		goto done;
 
 	fail_compile_shader:
 		glDeleteShader(result);
+		result = 0;
 
 	fail_shader_alloc:;
 	fail_data_alloc:
+	done:
+		for (i = 0; i < file_count; i++)
+		{
+			delete[] data[i];
+		}
+		delete[] data;
+
 		return result;
 	}
 
@@ -147,6 +169,16 @@ namespace XRShaderUtils
 		int shader_count,
 		bool delete_shaders,
 		bool check_errors)
+	{
+		return linkShaderProgram(shaders, shader_count, delete_shaders, NULL, 0, check_errors);
+	}
+
+	GLuint linkShaderProgram(const GLuint * shaders,
+		int shader_count,
+		bool delete_shaders,
+		const char * const * varyings,
+		int varying_count,
+		bool check_errors)
 	{
 		int i;
 
@@ -159,6 +191,11 @@ namespace XRShaderUtils
 			glAttachShader(program, shaders[i]);
 		}
 
+		if (varying_count > 0)
+		{
+			glTransformFeedbackVaryings(program, varying_count, varyings, GL_SEPARATE_ATTRIBS);
+		}
+
 		glLinkProgram(program);
 
 		if (check_errors)
@@ -189,4 +226,77 @@ namespace XRShaderUtils
 
 		return program;
 	}
+
+	void reflectProgram(GLuint id, Program& program)
+	{
+		GLint count = 0;
+		GLint size;
+		GLenum type;
+		GLuint i;
+		char name[256];
+
+		program.id = id;
+		program.uniforms.clear();
+		program.attributes.clear();
+		program.block_sizes.clear();
+
+		glGetProgramiv(id, GL_ACTIVE_UNIFORMS, &count);
+		for (i = 0; i < (GLuint)count; i++)
+		{
+			GLint block = -1;
+			glGetActiveUniformsiv(id, 1, &i, GL_UNIFORM_BLOCK_INDEX, &block);
+
+			//the members of uniform blocks have no location
+			if (block != -1)
+				continue;
+
+			glGetActiveUniform(id, i, sizeof(name), NULL, &size, &type, name);
+			GLint location = glGetUniformLocation(id, name);
+			char * bracket = strstr(name, "[0]");
+			if (bracket)
+				*bracket = 0;
+			program.uniforms[name] = location;
+		}
+
+		glGetProgramiv(id, GL_ACTIVE_ATTRIBUTES, &count);
+		for (i = 0; i < (GLuint)count; i++)
+		{
+			glGetActiveAttrib(id, i, sizeof(name), NULL, &size, &type, name);
+
+			//built in inputs such as gl_VertexID have no location
+			if (strncmp(name, "gl_", 3) == 0)
+				continue;
+
+			program.attributes[name] = glGetAttribLocation(id, name);
+		}
+
+		glGetProgramiv(id, GL_ACTIVE_UNIFORM_BLOCKS, &count);
+		for (i = 0; i < (GLuint)count; i++)
+		{
+			glGetActiveUniformBlockName(id, i, sizeof(name), NULL, name);
+			glGetActiveUniformBlockiv(id, i, GL_UNIFORM_BLOCK_DATA_SIZE, &size);
+			program.block_sizes[name] = size;
+		}
+	}
+
+	static GLint find(const std::map<std::string, GLint>& table, const char * name, GLint missing)
+	{
+		std::map<std::string, GLint>::const_iterator it = table.find(name);
+		return it == table.end() ? missing : it->second;
+	}
+
+	GLint uniformLocation(const Program& program, const char * name)
+	{
+		return find(program.uniforms, name, -1);
+	}
+
+	GLint attribLocation(const Program& program, const char * name)
+	{
+		return find(program.attributes, name, -1);
+	}
+
+	GLint uniformBlockSize(const Program& program, const char * name)
+	{
+		return find(program.block_sizes, name, 0);
+	}
 }
\ No newline at end of file
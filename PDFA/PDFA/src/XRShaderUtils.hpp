@@ -2,6 +2,8 @@
 #define XRSHADERUTILS_H
 
 #include <GL/glew.h>
+#include <map>
+#include <string>
 
 
 /**
@@ -12,6 +14,28 @@
  */
 namespace XRShaderUtils
 {
+		/**
+		 * The active uniforms, attributes and uniform blocks of a linked
+		 * program, read once after linking so that their locations are
+		 * looked up without asking the driver. Arrays are found by their
+		 * name without [0].
+		 */
+		struct Program
+		{
+			GLuint id;
+			std::map<std::string, GLint> uniforms;      //locations of the uniforms outside of blocks
+			std::map<std::string, GLint> attributes;    //locations of the vertex attributes
+			std::map<std::string, GLint> block_sizes;   //data sizes of the uniform blocks
+			Program() : id(0) {}
+		};
+
+		void reflectProgram(GLuint id, Program& program);
+
+		/* -1 for a uniform or attribute that is not active, 0 for a block */
+		GLint uniformLocation(const Program& program, const char * name);
+		GLint attribLocation(const Program& program, const char * name);
+		GLint uniformBlockSize(const Program& program, const char * name);
+
 		GLuint loadShader(const char * filename,
 			GLenum shader_type = GL_FRAGMENT_SHADER,
 #ifdef _DEBUG
@@ -20,6 +44,16 @@ namespace XRShaderUtils
 			bool check_errors = false);
 #endif
 
+		/* compile several files as the sources of one shader, in order */
+		GLuint loadShader(const char * const * filenames,
+			int file_count,
+			GLenum shader_type,
+#ifdef _DEBUG
+			bool check_errors = true);
+#else
+			bool check_errors = false);
+#endif
+
 		GLuint loadShaderFromSrc(const char * source,
 			GLenum shader_type,
 #ifdef _DEBUG
@@ -37,6 +71,18 @@ namespace XRShaderUtils
 			bool check_errors = false);
 #endif
 
+		/* link with the varyings captured by transform feedback, one buffer each */
+		GLuint linkShaderProgram(const GLuint * shaders,
+			int shader_count,
+			bool delete_shaders,
+			const char * const * varyings,
+			int varying_count,
+#ifdef _DEBUG
+			bool check_errors = true);
+#else
+			bool check_errors = false);
+#endif
+
 };
 
 #endif
\ No newline at end of file
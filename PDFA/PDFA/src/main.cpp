@@ -21,14 +21,29 @@ int main(void)
     /* Initialize the library */
     if (!glfwInit())
         return -1;
-	/* Create a windowed mode window and its OpenGL context */
+	/*
+	 * Create a windowed mode window and its OpenGL context, 4.3 core for the
+	 * storage buffers and compute shaders of the blend, else 3.3 core, where
+	 * the vertex shader and transform feedback blend from a buffer texture
+	 */
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
     window = glfwCreateWindow(APPLICATION_WWIDTH, APPLICATION_WHEIGHT, "PDFA", NULL, NULL);
-	glfwHideWindow(window); //hide window
     if (!window)
     {
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        window = glfwCreateWindow(APPLICATION_WWIDTH, APPLICATION_WHEIGHT, "PDFA", NULL, NULL);
+    }
+    if (!window)
+    {
+        std::cerr << "Cannot create an OpenGL 3.3 core context, aborting." << std::endl;
         glfwTerminate();
         return -1;
     }
+	glfwHideWindow(window); //hide window
     /* Make the window's context current */
     glfwMakeContextCurrent(window);
 
@@ -40,6 +55,13 @@ int main(void)
         std::cout<<"glewInit failed, aborting."<<std::endl;
         return -1;
     }
+	glGetError();   //glewInit queries the extension string the core profile dropped
+	if (!GLEW_VERSION_3_3)
+	{
+		std::cerr << "OpenGL 3.3 is required, the context is "
+			<< glGetString(GL_VERSION) << ", aborting." << std::endl;
+		return -1;
+	}
 
 	//INITIALIZE APPLICATION
 	Application::appSetup();
@@ -0,0 +1,114 @@
+//
+//  BatchBlend.cpp
+//  PDFA
+//
+//  Times the blend of a long weight animation on a compiled rig, frame by
+//  frame with BlendEngine::evaluate and as one batch with
+//  BlendEngine::evaluateFrames, and checks that both give the same meshes.
+//  With "half" the deltas are blended in half precision. Run the app once
+//  to compile the rig, then build and run from the PDFA/PDFA directory:
+//
+//    g++ -O2 -std=c++11 -pthread -Isrc -o BatchBlend tools/BatchBlend.cpp src/BlendEngine.cpp
+//        src/SimdKernels.cpp src/CpuFeatures.cpp src/ThreadPool.cpp src/RigFile.cpp src/FileUtils.cpp
+//    ./BatchBlend [file.rig] [frames] [frames per tile] [half]
+//
+
+#include "BlendEngine.hpp"
+#include "FileUtils.hpp"
+#include "RigFile.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+static double millisecondsSince(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char** argv)
+{
+	const char* filename = argc > 1 ? argv[1] : "res/model/humanHead/head.rig";
+	int num_frames = argc > 2 ? atoi(argv[2]) : 2000;
+	int tile_frames = argc > 3 ? atoi(argv[3]) : 16;
+	bool half = argc > 4 && strcmp(argv[4], "half") == 0;
+
+	RigFile::Rig rig;
+	FileUtils::MappedFile file;
+	if (!RigFile::open(filename, rig, file))
+	{
+		fprintf(stderr, "Cannot open rig file %s\n", filename);
+		return 1;
+	}
+
+	int nv = rig.num_vertices;
+	int K = rig.num_targets;
+	size_t size = (size_t)nv * 3;
+	BlendEngine::Rig engine;
+	BlendEngine::create(engine, rig.positions, rig.normals, nv, K);
+	for (int t = 0; t < K; t++)
+		BlendEngine::setTarget(engine, t, rig.bs_positions + size * t, rig.bs_normals + size * t);
+	BlendEngine::setHalfPrecision(engine, half);
+	FileUtils::unmapFile(file);
+
+	//every target eases in and out at its own rate
+	std::vector<float> weights((size_t)K * num_frames);
+	for (int t = 0; t < K; t++)
+	{
+		for (int f = 0; f < num_frames; f++)
+			weights[(size_t)t * num_frames + f] = 0.5f - 0.5f * std::cos(f * 0.05f * (t + 1));
+	}
+
+	printf("%s: %d vertices, %d targets, %d frames%s\n", filename, nv, K, num_frames, half ? ", half precision" : "");
+
+	size_t mesh_size = BlendEngine::meshSize(engine);
+	float* mesh = BlendEngine::allocate(mesh_size);
+	std::vector<float> frame_weights(K);
+	double checksum = 0.0;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (int f = 0; f < num_frames; f++)
+	{
+		for (int t = 0; t < K; t++) frame_weights[t] = weights[(size_t)t * num_frames + f];
+		BlendEngine::evaluate(engine, K > 0 ? &frame_weights[0] : NULL, mesh);
+		checksum += mesh[f % mesh_size];
+	}
+	double per_frame = millisecondsSince(start);
+
+	start = std::chrono::steady_clock::now();
+	BlendEngine::evaluateFrames(engine, K > 0 ? &weights[0] : NULL, num_frames, tile_frames,
+		[&](int first_frame, int count, const float* meshes) {
+			for (int f = 0; f < count; f++) checksum += meshes[mesh_size * f + (first_frame + f) % mesh_size];
+		});
+	double batch = millisecondsSince(start);
+
+	//compare every frame of the batch with the frame by frame blend
+	float max_error = 0.0f;
+	BlendEngine::evaluateFrames(engine, K > 0 ? &weights[0] : NULL, num_frames, tile_frames,
+		[&](int first_frame, int count, const float* meshes) {
+			for (int f = 0; f < count; f++)
+			{
+				for (int t = 0; t < K; t++) frame_weights[t] = weights[(size_t)t * num_frames + first_frame + f];
+				BlendEngine::evaluate(engine, K > 0 ? &frame_weights[0] : NULL, mesh);
+				for (size_t i = 0; i < mesh_size; i++)
+					max_error = std::max(max_error, std::fabs(meshes[mesh_size * f + i] - mesh[i]));
+			}
+		});
+
+	printf("  frame by frame %10.2f ms  %8.4f ms per frame\n", per_frame, per_frame / num_frames);
+	printf("  batched        %10.2f ms  %8.4f ms per frame, %d frames per tile\n", batch, batch / num_frames, tile_frames);
+	printf("  %.1fx faster, largest difference %g (checksum %g)\n", per_frame / batch, max_error, checksum);
+	if (half)
+	{
+		float position_error, normal_error;
+		BlendEngine::halfError(engine, K > 0 ? &frame_weights[0] : NULL, position_error, normal_error);
+		printf("  last frame differs from the float blend by %g (normals %g)\n", position_error, normal_error);
+	}
+
+	BlendEngine::release(mesh);
+	BlendEngine::destroy(engine);
+	return 0;
+}
@@ -0,0 +1,629 @@
+//
+//  ComputeBlendCheck.cpp
+//  PDFA
+//
+//  Checks the GPU blends of the app against the CPU on a compiled rig,
+//  with no window: on a surfaceless EGL context it runs blend.cs.glsl for
+//  every delta format, with and without the normal deltas, for a few and
+//  for all active targets, with the targets stored densely (epsilon 0)
+//  and sparsely, and compares the result to a blend in doubles of the
+//  deltas each format decodes to. The transform feedback blend is checked
+//  the same way, reading the deltas from the storage buffer and, on a 3.3
+//  core context, through the buffer texture of deltasTexture.glsl. Last,
+//  faceNormals.cs.glsl and vertexNormals.cs.glsl are compared to
+//  MeshNormals::compute. The deltas and the Weights block are laid out as
+//  Application::packBlendShape and Application::uploadWeights do. Run the
+//  app once to compile the rig, then build and run from the PDFA/PDFA
+//  directory (with Mesa and no display, EGL_PLATFORM=surfaceless):
+//
+//    g++ -O2 -std=c++11 -pthread -Isrc -o ComputeBlendCheck tools/ComputeBlendCheck.cpp src/BlendShapes.cpp
+//        src/MeshNormals.cpp src/SimdKernels.cpp src/CpuFeatures.cpp src/ThreadPool.cpp src/RigFile.cpp
+//        src/FileUtils.cpp -lEGL -lGL
+//    ./ComputeBlendCheck [file.rig] [epsilon]
+//
+
+#include "BlendShapes.hpp"
+#include "FileUtils.hpp"
+#include "MeshNormals.hpp"
+#include "RigFile.hpp"
+#include "SimdKernels.hpp"
+
+#include <EGL/egl.h>
+#define GL_GLEXT_PROTOTYPES 1
+#include <GL/glcorearb.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+enum { DELTAS_FLOAT = 1, DELTAS_HALF, DELTAS_SHORT, DELTAS_BYTE };
+static const char* formatNames[5] = { "", "float", "half", "16 bit", "8 bit" };
+
+//the bindings of the app, see Application.cpp and blend.cs.glsl
+static const GLuint weightsBinding = 0, frameBinding = 1, deltasBinding = 7, deltasUnit = 1;
+
+//largest differences accepted: float accumulation against doubles, relative to the size of the mesh
+static const double positionTolerance = 1e-5;
+static const double normalTolerance = 1e-4;
+
+struct ActiveTarget
+{
+	float position_weight[3];
+	GLuint offset;
+	float normal_weight[3];
+	GLuint count;
+};
+
+/* the deltas of every target packed for the shaders, and what they decode to */
+struct Packed
+{
+	std::vector<GLuint> words;
+	std::vector<GLuint> offsets;
+	std::vector<GLuint> counts;
+	std::vector<BlendShapes::QuantizedTarget> quantized;
+	std::vector<float> positions;   //decoded deltas, target after target
+	std::vector<float> normals;
+};
+
+static int failures = 0;
+
+static bool createContext(int major, int minor)
+{
+	static EGLDisplay display = EGL_NO_DISPLAY;
+	if (display == EGL_NO_DISPLAY)
+	{
+		display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+		if (!eglInitialize(display, NULL, NULL)) return false;
+		eglBindAPI(EGL_OPENGL_API);
+	}
+	EGLint config_attributes[] = { EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+	EGLConfig config = NULL;
+	EGLint num_configs = 0;
+	eglChooseConfig(display, config_attributes, &config, 1, &num_configs);
+	EGLint context_attributes[] = { EGL_CONTEXT_MAJOR_VERSION, major, EGL_CONTEXT_MINOR_VERSION, minor,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT, EGL_NONE };
+	EGLContext context = eglCreateContext(display, num_configs ? config : NULL, EGL_NO_CONTEXT, context_attributes);
+	if (context == EGL_NO_CONTEXT) return false;
+	if (!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) return false;
+	printf("OpenGL %s, %s\n", glGetString(GL_VERSION), glGetString(GL_RENDERER));
+	return true;
+}
+
+/* compile the files as the sources of one shader, in order, as XRShaderUtils::loadShader */
+static GLuint loadShader(const char* const* filenames, int count, GLenum type)
+{
+	std::vector<std::string> texts(count);
+	std::vector<const char*> sources(count);
+	for (int i = 0; i < count; i++)
+	{
+		std::ifstream in(filenames[i]);
+		if (!in)
+		{
+			printf("Cannot read %s\n", filenames[i]);
+			exit(1);
+		}
+		std::stringstream text;
+		text << in.rdbuf();
+		texts[i] = text.str();
+		sources[i] = texts[i].c_str();
+	}
+	GLuint shader = glCreateShader(type);
+	glShaderSource(shader, count, &sources[0], NULL);
+	glCompileShader(shader);
+	GLint ok = 0;
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &ok);
+	if (!ok)
+	{
+		char log[4096];
+		glGetShaderInfoLog(shader, sizeof(log), NULL, log);
+		printf("Cannot compile %s:\n%s\n", filenames[count - 1], log);
+		exit(1);
+	}
+	return shader;
+}
+
+/* link, bind the blocks and the delta texture as Application::bindBlocks */
+static GLuint linkProgram(const GLuint* shaders, int count, const char* const* varyings = NULL, int num_varyings = 0)
+{
+	GLuint program = glCreateProgram();
+	for (int i = 0; i < count; i++) glAttachShader(program, shaders[i]);
+	if (num_varyings > 0) glTransformFeedbackVaryings(program, num_varyings, varyings, GL_SEPARATE_ATTRIBS);
+	glLinkProgram(program);
+	GLint ok = 0;
+	glGetProgramiv(program, GL_LINK_STATUS, &ok);
+	if (!ok)
+	{
+		char log[4096];
+		glGetProgramInfoLog(program, sizeof(log), NULL, log);
+		printf("Cannot link:\n%s\n", log);
+		exit(1);
+	}
+	for (int i = 0; i < count; i++) glDeleteShader(shaders[i]);
+
+	const char* blocks[2] = { "Weights", "Frame" };
+	const GLuint bindings[2] = { weightsBinding, frameBinding };
+	for (int i = 0; i < 2; i++)
+	{
+		GLuint index = glGetUniformBlockIndex(program, blocks[i]);
+		if (index != GL_INVALID_INDEX) glUniformBlockBinding(program, index, bindings[i]);
+	}
+	glUseProgram(program);
+	GLint location = glGetUniformLocation(program, "deltaTexture");
+	if (location >= 0) glUniform1i(location, deltasUnit);
+	return program;
+}
+
+static GLuint createBuffer(GLenum target, size_t size, const void* data)
+{
+	GLuint buffer = 0;
+	glGenBuffers(1, &buffer);
+	glBindBuffer(target, buffer);
+	glBufferData(target, size, data, GL_STATIC_DRAW);
+	glBindBuffer(target, 0);
+	return buffer;
+}
+
+static void readBuffer(GLuint buffer, size_t count, float* data)
+{
+	glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+	glGetBufferSubData(GL_COPY_READ_BUFFER, 0, count * sizeof(float), data);
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+}
+
+/* as Application::packBlendShape, for all the targets */
+static void pack(const RigFile::Rig& rig, const std::vector<BlendShapes::SparseTarget>& targets, int format, bool normals,
+	Packed& packed)
+{
+	int num_vertices = rig.num_vertices;
+	size_t size = (size_t)num_vertices * 3;
+	int component = format == DELTAS_FLOAT ? 4 : format == DELTAS_BYTE ? 1 : 2;
+	int vertex = ((normals ? 6 : 3) * component + 3) & ~3;
+	packed.words.clear();
+	packed.offsets.assign(targets.size(), 0);
+	packed.counts.assign(targets.size(), 0);
+	packed.quantized.assign(targets.size(), BlendShapes::QuantizedTarget());
+	packed.positions.assign(size * targets.size(), 0.0f);
+	packed.normals.assign(size * targets.size(), 0.0f);
+
+	std::vector<float> bs_positions(size), bs_normals(size);
+	std::vector<SimdKernels::half> half_positions(size), half_normals(size);
+	for (size_t t = 0; t < targets.size(); t++)
+	{
+		float* decoded_positions = &packed.positions[size * t];
+		float* decoded_normals = &packed.normals[size * t];
+		BlendShapes::expand(targets[t], num_vertices, &bs_positions[0], &bs_normals[0]);
+		const void* data_positions = &bs_positions[0];
+		const void* data_normals = &bs_normals[0];
+		if (format == DELTAS_HALF)
+		{
+			SimdKernels::get().toHalf(&bs_positions[0], size, &half_positions[0]);
+			SimdKernels::get().toHalf(&bs_normals[0], size, &half_normals[0]);
+			data_positions = &half_positions[0];
+			data_normals = &half_normals[0];
+			for (size_t k = 0; k < size; k++)
+			{
+				decoded_positions[k] = SimdKernels::halfToFloat(half_positions[k]);
+				decoded_normals[k] = SimdKernels::halfToFloat(half_normals[k]);
+			}
+		}
+		else if (format != DELTAS_FLOAT)
+		{
+			BlendShapes::QuantizedTarget& q = packed.quantized[t];
+			BlendShapes::quantize(&bs_positions[0], &bs_normals[0], num_vertices, format == DELTAS_BYTE ? 8 : 16, q);
+			data_positions = &q.positions[0];
+			data_normals = &q.normals[0];
+			BlendShapes::dequantize(q, num_vertices, decoded_positions, decoded_normals);
+		}
+		else
+		{
+			std::copy(bs_positions.begin(), bs_positions.end(), decoded_positions);
+			std::copy(bs_normals.begin(), bs_normals.end(), decoded_normals);
+		}
+		if (!normals) std::fill(decoded_normals, decoded_normals + size, 0.0f);
+
+		const std::vector<unsigned int>& listed = targets[t].vertices;
+		GLuint count = (GLuint)listed.size();
+		size_t sparse_words = count + (size_t)(count + 1) * vertex / 4;
+		size_t dense_words = (size_t)num_vertices * vertex / 4;
+		bool dense = sparse_words >= dense_words;
+		size_t offset = packed.words.size();
+		packed.words.resize(offset + (dense ? dense_words : sparse_words), 0);
+		GLuint left_out = 0;
+		if (dense) count = num_vertices;
+		else
+		{
+			std::copy(listed.begin(), listed.end(), packed.words.begin() + offset);
+			while (left_out < count && listed[left_out] == left_out) left_out++;
+		}
+		char* rows = (char*)&packed.words[offset + (dense ? 0 : count)];
+		GLuint num_rows = dense ? count : count + 1;
+		for (GLuint r = 0; r < num_rows; r++)
+		{
+			GLuint v = dense ? r : r < count ? listed[r] : left_out;
+			memcpy(rows + (size_t)vertex * r, (const char*)data_positions + (size_t)component * 3 * v, component * 3);
+			if (normals)
+				memcpy(rows + (size_t)vertex * r + component * 3, (const char*)data_normals + (size_t)component * 3 * v, component * 3);
+		}
+		packed.offsets[t] = (GLuint)offset;
+		packed.counts[t] = count;
+	}
+}
+
+/* as Application::uploadWeights, returns numActive */
+static int writeWeights(const Packed& packed, const std::vector<float>& weights, int format, bool normals, GLuint buffer)
+{
+	std::vector<float> block(8 + 8 * weights.size(), 0.0f);
+	ActiveTarget* active = (ActiveTarget*)&block[8];
+	int n = 0;
+	for (size_t t = 0; t < weights.size(); t++)
+	{
+		if (weights[t] == 0.0f) continue;
+		ActiveTarget& a = active[n++];
+		a.offset = packed.offsets[t];
+		a.count = packed.counts[t];
+		for (int k = 0; k < 3; k++)
+		{
+			a.position_weight[k] = a.normal_weight[k] = weights[t];
+			if (format == DELTAS_FLOAT || format == DELTAS_HALF) continue;
+			const BlendShapes::QuantizedTarget& q = packed.quantized[t];
+			a.position_weight[k] *= q.position_scale[k];
+			a.normal_weight[k] *= q.normal_scale[k];
+			block[k] += weights[t] * q.position_offset[k];
+			if (normals) block[4 + k] += weights[t] * q.normal_offset[k];
+		}
+	}
+	glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(float) * 8 + sizeof(ActiveTarget) * n, &block[0]);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	return n;
+}
+
+/* neutral + sum of weight * decoded delta, in doubles; the normals are normalized when asked */
+static void blendReference(const RigFile::Rig& rig, const Packed& packed, const std::vector<float>& weights,
+	bool normalize, std::vector<float>& positions, std::vector<float>& normals)
+{
+	size_t size = (size_t)rig.num_vertices * 3;
+	positions.resize(size);
+	normals.resize(size);
+	for (size_t k = 0; k < size; k += 3)
+	{
+		double p[3], n[3];
+		for (int c = 0; c < 3; c++)
+		{
+			p[c] = rig.positions[k + c];
+			n[c] = rig.normals[k + c];
+			for (size_t t = 0; t < weights.size(); t++)
+			{
+				p[c] += (double)weights[t] * packed.positions[size * t + k + c];
+				n[c] += (double)weights[t] * packed.normals[size * t + k + c];
+			}
+		}
+		double length = normalize ? std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]) : 1.0;
+		for (int c = 0; c < 3; c++)
+		{
+			positions[k + c] = (float)p[c];
+			normals[k + c] = (float)(length > 0.0 ? n[c] / length : n[c]);
+		}
+	}
+}
+
+static double maxDifference(const std::vector<float>& a, const std::vector<float>& b)
+{
+	double d = 0.0;
+	for (size_t k = 0; k < a.size(); k++) d = std::max(d, (double)std::fabs(a[k] - b[k]));
+	return d;
+}
+
+static void report(const char* what, double position_error, double normal_error, double scale)
+{
+	bool ok = position_error <= positionTolerance * scale && normal_error <= normalTolerance * std::max(scale, 1.0);
+	if (!ok) failures++;
+	printf("  %-44s positions %.2e, normals %.2e%s\n", what, position_error, normal_error, ok ? "" : "  FAILED");
+}
+
+/* a few targets at large weights, then every target at small ones */
+static void weightSets(int num_targets, std::vector<float>& few, std::vector<float>& all)
+{
+	few.assign(num_targets, 0.0f);
+	all.assign(num_targets, 0.0f);
+	for (int t = 0; t < num_targets; t++)
+	{
+		if (t % 3 == 1) few[t] = 0.2f * (t % 5 + 1);
+		all[t] = 0.02f * (t % 7 + 1);
+	}
+}
+
+/* blend.cs.glsl into positions and normals, for every format and both layouts of the deltas */
+static void checkCompute(const RigFile::Rig& rig, const std::vector<BlendShapes::SparseTarget>& targets, double scale)
+{
+	const char* sources[3] = { "res/shader/deltasBuffer.glsl", "res/shader/blendShapes.glsl", "res/shader/blend.cs.glsl" };
+	GLuint shader = loadShader(sources, 3, GL_COMPUTE_SHADER);
+	GLuint program = linkProgram(&shader, 1);
+
+	size_t size = (size_t)rig.num_vertices * 3;
+	GLuint neutral[2] = { createBuffer(GL_SHADER_STORAGE_BUFFER, size * 4, rig.positions),
+		createBuffer(GL_SHADER_STORAGE_BUFFER, size * 4, rig.normals) };
+	GLuint out[2] = { createBuffer(GL_SHADER_STORAGE_BUFFER, size * 4, NULL), createBuffer(GL_SHADER_STORAGE_BUFFER, size * 4, NULL) };
+	GLuint deltas = createBuffer(GL_SHADER_STORAGE_BUFFER, 4, NULL);
+	GLuint weights_block = createBuffer(GL_UNIFORM_BUFFER, 32 + sizeof(ActiveTarget) * targets.size(), NULL);
+
+	std::vector<float> sets[2];
+	weightSets((int)targets.size(), sets[0], sets[1]);
+	std::vector<float> positions(size), normals(size), reference_positions, reference_normals;
+	Packed packed;
+	for (int normals_stored = 1; normals_stored >= 0; normals_stored--)
+	{
+		for (int format = DELTAS_FLOAT; format <= DELTAS_BYTE; format++)
+		{
+			pack(rig, targets, format, normals_stored != 0, packed);
+			glBindBuffer(GL_SHADER_STORAGE_BUFFER, deltas);
+			glBufferData(GL_SHADER_STORAGE_BUFFER, packed.words.size() * 4, &packed.words[0], GL_STATIC_DRAW);
+			glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+			glBindBufferBase(GL_SHADER_STORAGE_BUFFER, deltasBinding, deltas);
+			glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, out[0]);
+			glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, neutral[0]);
+			glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, neutral[1]);
+			glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, out[1]);
+			glBindBufferBase(GL_UNIFORM_BUFFER, weightsBinding, weights_block);
+
+			for (int s = 0; s < 2; s++)
+			{
+				int num_active = writeWeights(packed, sets[s], format, normals_stored != 0, weights_block);
+				glUseProgram(program);
+				glUniform1i(glGetUniformLocation(program, "numActive"), num_active);
+				glUniform1i(glGetUniformLocation(program, "numVertices"), rig.num_vertices);
+				glUniform1i(glGetUniformLocation(program, "deltaFormat"), format);
+				glUniform1i(glGetUniformLocation(program, "deltaNormals"), normals_stored);
+				glDispatchCompute((rig.num_vertices + 63) / 64, 1, 1);
+				glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+				readBuffer(out[0], size, &positions[0]);
+				readBuffer(out[1], size, &normals[0]);
+
+				blendReference(rig, packed, sets[s], false, reference_positions, reference_normals);
+				char what[128];
+				snprintf(what, sizeof(what), "%-6s %s, %3d active%s", formatNames[format],
+					normals_stored ? "deltas" : "positions", num_active, glGetError() != GL_NO_ERROR ? ", GL error" : "");
+				report(what, maxDifference(positions, reference_positions), maxDifference(normals, reference_normals), scale);
+			}
+		}
+	}
+	glDeleteBuffers(2, neutral);
+	glDeleteBuffers(2, out);
+	glDeleteBuffers(1, &deltas);
+	glDeleteBuffers(1, &weights_block);
+	glDeleteProgram(program);
+}
+
+/**
+ * The vertex shader of the app run over the neutral vertices with no
+ * rasterization, capturing m_position and m_normal as blendWithFeedback
+ * does, the deltas read from the storage buffer or the buffer texture.
+ * The render program is linked as well, to check the fragment shader.
+ */
+static void checkFeedback(const RigFile::Rig& rig, const std::vector<BlendShapes::SparseTarget>& targets, double scale,
+	bool texture)
+{
+	const char* sources[3] = { texture ? "res/shader/deltasTexture.glsl" : "res/shader/deltasBuffer.glsl",
+		"res/shader/blendShapes.glsl", "res/shader/defaultShader.vs.glsl" };
+	const char* varyings[2] = { "m_position", "m_normal" };
+	GLuint shader = loadShader(sources, 3, GL_VERTEX_SHADER);
+	GLuint program = linkProgram(&shader, 1, varyings, 2);
+
+	const char* fragment_source = "res/shader/defaultShader.fs.glsl";
+	GLuint render_shaders[2] = { loadShader(sources, 3, GL_VERTEX_SHADER), loadShader(&fragment_source, 1, GL_FRAGMENT_SHADER) };
+	glDeleteProgram(linkProgram(render_shaders, 2));
+
+	//a surfaceless context has no default framebuffer, and drawing needs a complete one even with no rasterization
+	GLuint framebuffer = 0, renderbuffer = 0;
+	glGenFramebuffers(1, &framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glGenRenderbuffers(1, &renderbuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, renderbuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, 4, 4);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffer);
+
+	size_t size = (size_t)rig.num_vertices * 3;
+	GLuint vertices[2] = { createBuffer(GL_ARRAY_BUFFER, size * 4, rig.positions), createBuffer(GL_ARRAY_BUFFER, size * 4, rig.normals) };
+	GLuint out[2] = { createBuffer(GL_ARRAY_BUFFER, size * 4, NULL), createBuffer(GL_ARRAY_BUFFER, size * 4, NULL) };
+	GLuint vao = 0;
+	glGenVertexArrays(1, &vao);
+	glBindVertexArray(vao);
+	glBindBuffer(GL_ARRAY_BUFFER, vertices[0]);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
+	glEnableVertexAttribArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, vertices[1]);
+	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 0, 0);
+	glEnableVertexAttribArray(2);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	//identity transforms, the captured mesh is in model space anyway
+	float frame[3 * 16 + 8] = { 0 };
+	for (int m = 0; m < 3; m++)
+		for (int i = 0; i < 4; i++) frame[16 * m + 5 * i] = 1.0f;
+	GLuint frame_block = createBuffer(GL_UNIFORM_BUFFER, sizeof(frame), frame);
+	GLuint weights_block = createBuffer(GL_UNIFORM_BUFFER, 32 + sizeof(ActiveTarget) * targets.size(), NULL);
+	GLuint deltas = createBuffer(texture ? GL_TEXTURE_BUFFER : GL_SHADER_STORAGE_BUFFER, 4, NULL);
+	GLuint deltas_texture = 0;
+	if (texture)
+	{
+		glGenTextures(1, &deltas_texture);
+		glActiveTexture(GL_TEXTURE0 + deltasUnit);
+		glBindTexture(GL_TEXTURE_BUFFER, deltas_texture);
+		glTexBuffer(GL_TEXTURE_BUFFER, GL_R32UI, deltas);
+		glActiveTexture(GL_TEXTURE0);
+	}
+	else
+	{
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, deltasBinding, deltas);
+	}
+	glBindBufferBase(GL_UNIFORM_BUFFER, frameBinding, frame_block);
+	glBindBufferBase(GL_UNIFORM_BUFFER, weightsBinding, weights_block);
+	glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, out[0]);
+	glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 1, out[1]);
+
+	std::vector<float> sets[2];
+	weightSets((int)targets.size(), sets[0], sets[1]);
+	std::vector<float> positions(size), normals(size), reference_positions, reference_normals;
+	Packed packed;
+	for (int format = DELTAS_FLOAT; format <= DELTAS_BYTE; format++)
+	{
+		pack(rig, targets, format, true, packed);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, deltas);
+		glBufferData(GL_COPY_WRITE_BUFFER, packed.words.size() * 4, &packed.words[0], GL_STATIC_DRAW);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		for (int s = 0; s < 2; s++)
+		{
+			int num_active = writeWeights(packed, sets[s], format, true, weights_block);
+			glUseProgram(program);
+			glUniform1i(glGetUniformLocation(program, "numActive"), num_active);
+			glUniform1i(glGetUniformLocation(program, "numVertices"), rig.num_vertices);
+			glUniform1i(glGetUniformLocation(program, "deltaFormat"), format);
+			glUniform1i(glGetUniformLocation(program, "deltaNormals"), 1);
+			glEnable(GL_RASTERIZER_DISCARD);
+			glBeginTransformFeedback(GL_POINTS);
+			glDrawArrays(GL_POINTS, 0, rig.num_vertices);
+			glEndTransformFeedback();
+			glDisable(GL_RASTERIZER_DISCARD);
+			readBuffer(out[0], size, &positions[0]);
+			readBuffer(out[1], size, &normals[0]);
+
+			blendReference(rig, packed, sets[s], true, reference_positions, reference_normals);
+			char what[128];
+			snprintf(what, sizeof(what), "%-6s %3d active%s", formatNames[format], num_active,
+				glGetError() != GL_NO_ERROR ? ", GL error" : "");
+			report(what, maxDifference(positions, reference_positions), maxDifference(normals, reference_normals), scale);
+		}
+	}
+	glBindVertexArray(0);
+	glDeleteVertexArrays(1, &vao);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glDeleteFramebuffers(1, &framebuffer);
+	glDeleteRenderbuffers(1, &renderbuffer);
+	glDeleteTextures(1, &deltas_texture);
+	GLuint buffers[7] = { vertices[0], vertices[1], out[0], out[1], frame_block, weights_block, deltas };
+	glDeleteBuffers(7, buffers);
+	glDeleteProgram(program);
+}
+
+/* the two passes of Application::recomputeNormalsOnGPU against MeshNormals::compute, on a few blends */
+static void checkNormals(const RigFile::Rig& rig, const std::vector<BlendShapes::SparseTarget>& targets)
+{
+	if (rig.indices == NULL)
+	{
+		printf("  the mesh is not indexed, no normals to check\n");
+		return;
+	}
+	const char* face_source = "res/shader/faceNormals.cs.glsl";
+	const char* vertex_source = "res/shader/vertexNormals.cs.glsl";
+	GLuint shader = loadShader(&face_source, 1, GL_COMPUTE_SHADER);
+	GLuint face_program = linkProgram(&shader, 1);
+	shader = loadShader(&vertex_source, 1, GL_COMPUTE_SHADER);
+	GLuint vertex_program = linkProgram(&shader, 1);
+
+	size_t size = (size_t)rig.num_vertices * 3;
+	MeshNormals::Adjacency adjacency;
+	MeshNormals::buildAdjacency(rig.indices, rig.num_indices, rig.positions, rig.num_vertices, adjacency);
+	const std::vector<int>* arrays[3] = { &adjacency.welded, &adjacency.offsets, &adjacency.triangles };
+	GLuint buffers[7];
+	buffers[0] = createBuffer(GL_SHADER_STORAGE_BUFFER, size * 4, NULL);
+	buffers[1] = createBuffer(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint) * rig.num_indices, rig.indices);
+	buffers[2] = createBuffer(GL_SHADER_STORAGE_BUFFER, sizeof(GLfloat) * rig.num_indices, NULL);
+	for (int i = 0; i < 3; i++) buffers[3 + i] = createBuffer(GL_SHADER_STORAGE_BUFFER, sizeof(GLint) * arrays[i]->size(), &(*arrays[i])[0]);
+	buffers[6] = createBuffer(GL_SHADER_STORAGE_BUFFER, size * 4, NULL);
+	for (int i = 0; i < 7; i++) glBindBufferBase(GL_SHADER_STORAGE_BUFFER, i, buffers[i]);
+
+	std::vector<float> sets[3];
+	weightSets((int)targets.size(), sets[1], sets[2]);
+	sets[0].assign(targets.size(), 0.0f);
+	const char* names[3] = { "neutral", "few targets", "all targets" };
+	Packed packed;
+	pack(rig, targets, DELTAS_FLOAT, true, packed);
+	std::vector<float> positions, blended_normals, normals(size), gpu_normals(size), face_normals;
+	for (int s = 0; s < 3; s++)
+	{
+		blendReference(rig, packed, sets[s], false, positions, blended_normals);
+		MeshNormals::compute(adjacency, rig.indices, rig.num_indices, &positions[0], rig.num_vertices, &normals[0], face_normals);
+
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffers[0]);
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, size * 4, &positions[0]);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+		GLuint num_triangles = (GLuint)rig.num_indices / 3;
+		glUseProgram(face_program);
+		glUniform1ui(glGetUniformLocation(face_program, "numTriangles"), num_triangles);
+		glDispatchCompute((num_triangles + 63) / 64, 1, 1);
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+		glUseProgram(vertex_program);
+		glUniform1ui(glGetUniformLocation(vertex_program, "numVertices"), (GLuint)rig.num_vertices);
+		glDispatchCompute((rig.num_vertices + 63) / 64, 1, 1);
+		glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+		readBuffer(buffers[6], size, &gpu_normals[0]);
+
+		char what[128];
+		snprintf(what, sizeof(what), "%s%s", names[s], glGetError() != GL_NO_ERROR ? ", GL error" : "");
+		report(what, 0.0, maxDifference(gpu_normals, normals), 1.0);
+	}
+	glDeleteBuffers(7, buffers);
+	glDeleteProgram(face_program);
+	glDeleteProgram(vertex_program);
+}
+
+int main(int argc, char** argv)
+{
+	const char* filename = argc > 1 ? argv[1] : "res/model/humanHead/head.rig";
+	float epsilon = argc > 2 ? (float)atof(argv[2]) : 0.01f;
+
+	RigFile::Rig rig;
+	FileUtils::MappedFile file;
+	if (!RigFile::open(filename, rig, file))
+	{
+		printf("Cannot open %s, run the app once to compile it\n", filename);
+		return 1;
+	}
+	size_t size = (size_t)rig.num_vertices * 3;
+	double scale = 0.0;
+	for (size_t k = 0; k < size; k++) scale = std::max(scale, (double)std::fabs(rig.positions[k]));
+	printf("%d vertices, %d targets\n", rig.num_vertices, rig.num_targets);
+
+	if (!createContext(4, 3))
+	{
+		printf("Cannot create an OpenGL 4.3 core context\n");
+		return 1;
+	}
+	const float epsilons[2] = { 0.0f, epsilon };
+	std::vector<BlendShapes::SparseTarget> targets(rig.num_targets);
+	for (int e = 0; e < 2; e++)
+	{
+		size_t kept = 0;
+		for (int t = 0; t < rig.num_targets; t++)
+		{
+			BlendShapes::makeSparse(rig.bs_positions + size * t, rig.bs_normals + size * t, rig.num_vertices, epsilons[e], targets[t]);
+			kept += targets[t].vertices.size();
+		}
+		printf("Epsilon %g, %.1f%% of the deltas kept\n", epsilons[e], 100.0 * kept / ((double)rig.num_vertices * rig.num_targets));
+		printf(" blend.cs.glsl\n");
+		checkCompute(rig, targets, scale);
+		printf(" transform feedback, storage buffer\n");
+		checkFeedback(rig, targets, scale, false);
+	}
+	printf("GPU normals against MeshNormals::compute\n");
+	checkNormals(rig, targets);
+
+	if (createContext(3, 3))
+	{
+		printf(" transform feedback, buffer texture\n");
+		checkFeedback(rig, targets, scale, true);
+	}
+	else
+	{
+		printf("Cannot create an OpenGL 3.3 core context, the buffer texture is not checked\n");
+	}
+
+	printf(failures == 0 ? "All the GPU blends match\n" : "%d checks FAILED\n", failures);
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,82 @@
+//
+//  DeltaQuantization.cpp
+//  PDFA
+//
+//  Reports the error and size of the blendshape deltas of a compiled rig
+//  when stored as 16 and 8 bit integers, per target, and checks the blend
+//  of all targets decoded on the fly against the float deltas. Run the app
+//  once to compile the rig, then build and run from the PDFA/PDFA directory:
+//
+//    g++ -O2 -std=c++11 -Isrc -o DeltaQuantization
+//        tools/DeltaQuantization.cpp src/BlendShapes.cpp src/RigFile.cpp src/FileUtils.cpp
+//    ./DeltaQuantization [file.rig]
+//
+
+#include "BlendShapes.hpp"
+#include "FileUtils.hpp"
+#include "RigFile.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+static float maxDistance(const float* a, const float* b, int num_vertices)
+{
+	float d = 0.0f;
+	for (size_t i = 0; i < (size_t)num_vertices * 3; i += 3)
+	{
+		float x = a[i] - b[i], y = a[i + 1] - b[i + 1], z = a[i + 2] - b[i + 2];
+		d = std::max(d, std::sqrt(x * x + y * y + z * z));
+	}
+	return d;
+}
+
+int main(int argc, char** argv)
+{
+	const char* filename = argc > 1 ? argv[1] : "res/model/humanHead/head.rig";
+
+	RigFile::Rig rig;
+	FileUtils::MappedFile file;
+	if (!RigFile::open(filename, rig, file))
+	{
+		fprintf(stderr, "Cannot open rig file %s\n", filename);
+		return 1;
+	}
+
+	int nv = rig.num_vertices;
+	size_t size = (size_t)nv * 3;
+	printf("%s: %d vertices, %d targets, %.2f MB of float deltas\n", filename, nv, rig.num_targets,
+		2.0 * size * sizeof(float) * rig.num_targets / (1024.0 * 1024.0));
+
+	//the blend of every target at full weight, as a worst case for accumulated error
+	std::vector<float> weights(rig.num_targets, 1.0f);
+	std::vector<BlendShapes::SparseTarget> exact(rig.num_targets);
+	for (int t = 0; t < rig.num_targets; t++)
+		BlendShapes::makeSparse(rig.bs_positions + size * t, rig.bs_normals + size * t, nv, 0.0f, exact[t]);
+	std::vector<float> reference_positions(size), reference_normals(size);
+	BlendShapes::evaluate(rig.positions, rig.normals, nv, &exact[0], &weights[0], rig.num_targets,
+		&reference_positions[0], &reference_normals[0]);
+
+	const int bits[] = { 16, 8 };
+	for (int b = 0; b < 2; b++)
+	{
+		std::vector<BlendShapes::QuantizedTarget> targets(rig.num_targets);
+		printf("\n%d bit, %.1fx smaller\n", bits[b], 32.0 / bits[b]);
+		printf("  target   position error   normal error\n");
+		for (int t = 0; t < rig.num_targets; t++)
+		{
+			BlendShapes::quantize(rig.bs_positions + size * t, rig.bs_normals + size * t, nv, bits[b], targets[t]);
+			printf("  %6d   %14.6f   %12.6f\n", t, targets[t].max_position_error, targets[t].max_normal_error);
+		}
+
+		std::vector<float> positions(size), normals(size);
+		BlendShapes::evaluate(rig.positions, rig.normals, nv, &targets[0], &weights[0], rig.num_targets,
+			&positions[0], &normals[0]);
+		printf("  all targets blended: %.6f (position) %.6f (normal)\n",
+			maxDistance(&positions[0], &reference_positions[0], nv), maxDistance(&normals[0], &reference_normals[0], nv));
+	}
+
+	FileUtils::unmapFile(file);
+	return 0;
+}
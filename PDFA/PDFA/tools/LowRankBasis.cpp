@@ -0,0 +1,94 @@
+//
+//  LowRankBasis.cpp
+//  PDFA
+//
+//  Factors the blendshape deltas of a compiled rig into principal
+//  components and reports, for every rank, the reconstruction error, the
+//  memory of the basis and the time of a CPU blend with BlendEngine, then
+//  the smallest rank within a tolerance. Run the app once to compile the
+//  rig, then build and run from the PDFA/PDFA directory:
+//
+//    g++ -O2 -std=c++11 -pthread -Isrc -o LowRankBasis tools/LowRankBasis.cpp src/BlendShapes.cpp src/BlendEngine.cpp
+//        src/SimdKernels.cpp src/CpuFeatures.cpp src/ThreadPool.cpp src/RigFile.cpp src/FileUtils.cpp
+//    ./LowRankBasis [file.rig] [tolerance]
+//
+
+#include "BlendEngine.hpp"
+#include "BlendShapes.hpp"
+#include "FileUtils.hpp"
+#include "RigFile.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+/* milliseconds per blend of the basis meshes with every weight non zero */
+static double timeBlend(const BlendShapes::LowRankBasis& basis, const float* positions, const float* normals,
+	int num_vertices)
+{
+	if (basis.rank == 0) return 0.0;
+	size_t size = (size_t)num_vertices * 3;
+	BlendEngine::Rig rig;
+	BlendEngine::create(rig, positions, normals, num_vertices, basis.rank);
+	for (int i = 0; i < basis.rank; i++)
+		BlendEngine::setTarget(rig, i, &basis.positions[size * i], &basis.normals[size * i]);
+	float* out = BlendEngine::allocate(BlendEngine::meshSize(rig));
+	std::vector<float> weights(basis.rank, 0.5f);
+
+	const int runs = 200;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (int i = 0; i < runs; i++) BlendEngine::evaluate(rig, &weights[0], out);
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / runs;
+
+	BlendEngine::release(out);
+	BlendEngine::destroy(rig);
+	return ms;
+}
+
+int main(int argc, char** argv)
+{
+	const char* filename = argc > 1 ? argv[1] : "res/model/humanHead/head.rig";
+	float tolerance = argc > 2 ? (float)atof(argv[2]) : 0.01f;
+
+	RigFile::Rig rig;
+	FileUtils::MappedFile file;
+	if (!RigFile::open(filename, rig, file))
+	{
+		fprintf(stderr, "Cannot open rig file %s\n", filename);
+		return 1;
+	}
+
+	int nv = rig.num_vertices;
+	int K = rig.num_targets;
+	size_t size = (size_t)nv * 3;
+	std::vector<const float*> bs_positions(K), bs_normals(K);
+	for (int t = 0; t < K; t++)
+	{
+		bs_positions[t] = rig.bs_positions + size * t;
+		bs_normals[t] = rig.bs_normals + size * t;
+	}
+	printf("%s: %d vertices, %d targets\n", filename, nv, K);
+
+	BlendShapes::LowRankBasis basis;
+	BlendShapes::factorize(&bs_positions[0], &bs_normals[0], nv, K, basis);
+	double total = 0.0;
+	for (int i = 0; i < K; i++) total += (double)basis.singular_values[i] * basis.singular_values[i];
+
+	printf("\n  rank   energy   position error   normal error   basis MB   blend ms\n");
+	for (int rank = 1; rank <= K; rank++)
+	{
+		BlendShapes::setRank(basis, rank);
+		double energy = 0.0;
+		for (int i = 0; i < rank; i++) energy += (double)basis.singular_values[i] * basis.singular_values[i];
+		printf("  %4d   %5.1f%%   %14.6f   %12.6f   %8.2f   %8.3f\n", rank, 100.0 * energy / total,
+			basis.max_position_error, basis.max_normal_error,
+			2.0 * size * sizeof(float) * rank / (1024.0 * 1024.0), timeBlend(basis, rig.positions, rig.normals, nv));
+	}
+
+	BlendShapes::setRankForError(basis, tolerance);
+	printf("\nrank %d of %d is within %g (error %f)\n", basis.rank, K, tolerance, basis.max_position_error);
+
+	FileUtils::unmapFile(file);
+	return 0;
+}
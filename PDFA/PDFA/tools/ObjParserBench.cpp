@@ -0,0 +1,93 @@
+//
+//  ObjParserBench.cpp
+//  PDFA
+//
+//  Measures the throughput of ObjParser against tinyobj::LoadObj on the same
+//  files and checks that both produce identical shapes. Build and run from
+//  the PDFA/PDFA directory so the default model paths resolve, e.g.
+//
+//    g++ -O2 -std=c++11 -Iinclude -Isrc -o ObjParserBench
+//        tools/ObjParserBench.cpp src/ObjParser.cpp src/FileUtils.cpp
+//    ./ObjParserBench [file.obj ...]
+//
+
+#define TINYOBJLOADER_IMPLEMENTATION
+#include <tiny_obj_loader.h>
+#include "ObjParser.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+static const char* defaultFiles[] =
+{
+	"res/model/humanHead/head-reference.obj",
+	"res/model/humanHead/head-01-anger.obj",
+	"res/model/alienHead(problematic)/FaceDefault.obj",
+	"res/model/bunny/bunny.obj",
+};
+
+template <typename T>
+static bool sameArray(const std::vector<T>& a, const std::vector<T>& b)
+{
+	return a.size() == b.size() && (a.empty() || memcmp(&a[0], &b[0], a.size() * sizeof(T)) == 0);
+}
+
+static bool sameShapes(const std::vector<tinyobj::shape_t>& a, const std::vector<tinyobj::shape_t>& b)
+{
+	if (a.size() != b.size()) return false;
+	for (size_t i = 0; i < a.size(); i++)
+	{
+		const tinyobj::mesh_t& ma = a[i].mesh;
+		const tinyobj::mesh_t& mb = b[i].mesh;
+		if (a[i].name != b[i].name
+			|| !sameArray(ma.positions, mb.positions) || !sameArray(ma.normals, mb.normals)
+			|| !sameArray(ma.texcoords, mb.texcoords) || !sameArray(ma.indices, mb.indices)
+			|| !sameArray(ma.num_vertices, mb.num_vertices) || !sameArray(ma.material_ids, mb.material_ids))
+			return false;
+	}
+	return true;
+}
+
+template <typename F>
+static double bestOf(int runs, F f)
+{
+	double best = 1e30;
+	for (int i = 0; i < runs; i++)
+	{
+		std::chrono::high_resolution_clock::time_point t0 = std::chrono::high_resolution_clock::now();
+		f();
+		std::chrono::duration<double> dt = std::chrono::high_resolution_clock::now() - t0;
+		if (dt.count() < best) best = dt.count();
+	}
+	return best;
+}
+
+int main(int argc, char** argv)
+{
+	int numFiles = argc > 1 ? argc - 1 : (int)(sizeof(defaultFiles) / sizeof(defaultFiles[0]));
+	const char* const* files = argc > 1 ? argv + 1 : defaultFiles;
+	bool allSame = true;
+
+	printf("%-50s %10s %12s %12s %8s\n", "file", "MB", "tinyobj MB/s", "parser MB/s", "same");
+	for (int i = 0; i < numFiles; i++)
+	{
+		FILE* fp = fopen(files[i], "rb");
+		if (!fp) { printf("%-50s missing\n", files[i]); continue; }
+		fseek(fp, 0, SEEK_END);
+		double mb = ftell(fp) / (1024.0 * 1024.0);
+		fclose(fp);
+
+		std::vector<tinyobj::shape_t> reference, shapes;
+		std::vector<tinyobj::material_t> materials;
+		std::string err;
+		double tTiny = bestOf(3, [&]() { materials.clear(); err.clear(); tinyobj::LoadObj(reference, materials, err, files[i]); });
+		double tFast = bestOf(10, [&]() { materials.clear(); err.clear(); ObjParser::loadObj(shapes, materials, err, files[i]); });
+
+		bool same = sameShapes(reference, shapes);
+		allSame = allSame && same;
+		printf("%-50s %10.2f %12.1f %12.1f %8s   (%.2f ms)\n", files[i], mb, mb / tTiny, mb / tFast,
+			same ? "yes" : "NO", tFast * 1000.0);
+	}
+	return allSame ? 0 : 1;
+}